@@ -0,0 +1,90 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+/**
+ * A fixed-capacity FIFO queue for passing items between threads.
+ *
+ * push() blocks while the queue is full and pop() blocks while the queue is empty. After close() has been called,
+ * push() fails immediately and pop() returns the remaining items before it fails as well.
+ *
+ * The queue remembers the maximum number of items it has held (high-water mark). A high-water mark that reaches the
+ * capacity means that the consumer could not keep up with the producer at some point.
+ */
+template <typename T> class BoundedQueue {
+  public:
+    explicit BoundedQueue(size_t capacity) : items_(capacity > 0 ? capacity : 1) {}
+
+    /**
+     * Appends an item to the queue. Blocks while the queue is full.
+     *
+     * @returns false if the queue has been closed (the item is discarded in that case).
+     */
+    bool push(T item) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        notFull_.wait(lock, [this] { return closed_ || size_ < items_.size(); });
+        if (closed_) {
+            return false;
+        }
+
+        items_[(head_ + size_) % items_.size()] = std::move(item);
+        ++size_;
+        if (size_ > highWaterMark_) {
+            highWaterMark_ = size_;
+        }
+        lock.unlock();
+        notEmpty_.notify_one();
+        return true;
+    }
+
+    /**
+     * Removes the oldest item from the queue. Blocks while the queue is empty.
+     *
+     * @returns false if the queue has been closed and no items are left.
+     */
+    bool pop(T &item) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        notEmpty_.wait(lock, [this] { return closed_ || size_ > 0; });
+        if (size_ == 0) {
+            return false;
+        }
+
+        item = std::move(items_[head_]);
+        head_ = (head_ + 1) % items_.size();
+        --size_;
+        lock.unlock();
+        notFull_.notify_one();
+        return true;
+    }
+
+    void close() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            closed_ = true;
+        }
+        notFull_.notify_all();
+        notEmpty_.notify_all();
+    }
+
+    size_t capacity() const { return items_.size(); }
+
+    // Returns the maximum number of items that the queue has held at the same time.
+    size_t highWaterMark() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return highWaterMark_;
+    }
+
+  private:
+    std::vector<T> items_;
+    size_t head_ = 0;
+    size_t size_ = 0;
+    size_t highWaterMark_ = 0;
+    bool closed_ = false;
+    mutable std::mutex mutex_;
+    std::condition_variable notFull_;
+    std::condition_variable notEmpty_;
+};
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <opencv2/core.hpp>
+#include <vector>
+
+#include "ProcessingParameters.h"
+
+/**
+ * Owns all scratch state that correct_frame needs to process a frame.
+ *
+ * The buffers are sized once for the frame geometry (see prepare), so correcting further frames of the same size
+ * does not allocate any memory. Each thread that calls correct_frame needs its own DeshakeContext.
+ */
+class DeshakeContext {
+  public:
+    /**
+     * Sizes all buffers for frames of the given size. correct_frame calls this itself, so it only has to be called
+     * explicitly to allocate the buffers in advance. Does nothing if the buffers already have the right size.
+     */
+    void prepare(const cv::Size &frameSize, const ProcessingParameters &parameters);
+
+    // Grayscale copies of the left- and right-hand borders (only used with ProcessingParameters::SCAN_METHOD_GRAY).
+    cv::Mat grayBuffer1, grayBuffer2;
+
+    // The line starts detected from the left-hand side. After correct_frame has returned, these are the final
+    // (merged, gap-filled and smoothed) line starts of the frame.
+    std::vector<int> lineStarts;
+
+    // The line starts detected from the right-hand side (referred to as line ends).
+    std::vector<int> lineEnds;
+
+    // The lengths of the line-start segments that survived the denoising, for the left- and right-hand side.
+    std::vector<int> segmentSizesStart, segmentSizesEnd;
+
+    // If true, analyze_frame keeps copies of the raw line starts and line ends (before the denoising) in rawLineStarts
+    // and rawLineEnds. Off by default because the copies are only needed to store them (see LineStartsWriter).
+    bool keepRawLineStarts = false;
+    std::vector<int> rawLineStarts, rawLineEnds;
+
+    // Scratch buffer for the line-start smoothing.
+    std::vector<int> smoothingBuffer;
+
+    // The number of rows where the left-hand (starts) or right-hand (ends) line start won the merge.
+    int mergedFromStartsCount = 0;
+    int mergedFromEndsCount = 0;
+
+    // Temporal prior (only used if ProcessingParameters::temporalSearchWindow > 0): the final line starts of the
+    // previous frame, around which the borders of the next frame are searched. Not valid after a scene change.
+    std::vector<int> previousLineStarts;
+    bool hasPreviousLineStarts = false;
+
+    // Per row: the number of sides (0-2) where the edge was not found in the window, so that the row was scanned fully.
+    std::vector<uint8_t> temporalFallbacks;
+
+    // The number of border searches of the last frame that used the prior, and how many of them fell back to a full
+    // scan. temporalPriorReset is true if the prior has been dropped because of a scene change.
+    int temporalWindowRows = 0;
+    int temporalFallbackRows = 0;
+    bool temporalPriorReset = false;
+
+    // Copies of the borders of the previous frame (only if ProcessingParameters::detectDuplicateFrames is set).
+    // duplicateFrame is true if the borders of the last frame were identical, i.e. its line starts have been reused.
+    // This assumes that the detection parameters do not change between frames.
+    cv::Mat previousLeftBorder, previousRightBorder;
+    bool hasPreviousBorders = false;
+    bool duplicateFrame = false;
+
+  private:
+    cv::Size frameSize_;
+    int colRange_ = 0;
+    int scanMethod_ = -1;
+};
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <opencv2/core.hpp>
+#include <string>
+
+/**
+ * Pixel formats of the frames that are processed.
+ *
+ * BGR24 frames are stored in CV_8UC3 Mats. Planar YUV frames are stored in a single continuous CV_8UC1 Mat that has
+ * the width of the frame and contains the Y plane followed by the U and V planes (the same layout that OpenCV uses for
+ * I420, e.g. a 720x576 YUV 4:2:0 frame is stored in a Mat with 720 columns and 864 rows).
+ */
+enum FrameFormat { FRAME_FORMAT_BGR24 = 0, FRAME_FORMAT_YUV420P = 1, FRAME_FORMAT_YUV422P = 2 };
+
+// Values of black in the planes of limited-range ("TV range") YUV video. Used to fill the gaps created by shifting.
+const uint8_t YUV_BLACK_LUMA = 16;
+const uint8_t YUV_BLACK_CHROMA = 128;
+
+// Returns true for the planar YUV formats.
+bool is_planar_yuv(FrameFormat format);
+
+// Horizontal and vertical chroma subsampling as shift (e.g. 1 = half resolution). 0 for BGR24.
+int chroma_shift_x(FrameFormat format);
+int chroma_shift_y(FrameFormat format);
+
+/**
+ * Returns the size of the Mat that holds a frame of the given size in the given format (e.g. 720x864 for a 720x576
+ * YUV 4:2:0 frame).
+ *
+ * @throws std::invalid_argument if the frame size is not compatible with the chroma subsampling of the format
+ */
+cv::Size get_frame_buffer_size(const cv::Size &frameSize, FrameFormat format);
+
+// Returns the type of the Mat that holds a frame in the given format (CV_8UC3 or CV_8UC1).
+int get_frame_buffer_type(FrameFormat format);
+
+/**
+ * Allocates buffer (if necessary) for a frame of the given size in the given format.
+ *
+ * @throws std::invalid_argument if the frame size is not compatible with the chroma subsampling of the format
+ */
+void create_frame_buffer(cv::Mat &buffer, const cv::Size &frameSize, FrameFormat format);
+
+// Returns the size (of the luma plane) of the frame that is stored in buffer.
+cv::Size get_frame_size(const cv::Mat &buffer, FrameFormat format);
+
+/**
+ * Returns a Mat header for one plane of a planar YUV frame (0 = Y, 1 = U, 2 = V). No data is copied.
+ */
+cv::Mat get_plane(const cv::Mat &buffer, FrameFormat format, int plane);
+
+// Parses "bgr24", "yuv420p" or "yuv422p" (the names used by FFmpeg). Returns false for other names.
+bool parse_frame_format(const std::string &name, FrameFormat &format);
+
+// Returns the FFmpeg name of the format.
+const char *frame_format_name(FrameFormat format);
@@ -0,0 +1,81 @@
+#pragma once
+
+#include "FrameFormat.h"
+
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <opencv2/core.hpp>
+#include <vector>
+
+/**
+ * A fixed number of preallocated frame buffers (slots) that are reused for all frames of a video.
+ *
+ * Each slot consists of an input buffer (the decoded frame) and an output buffer (the corrected frame). A slot is
+ * checked out with acquire() before a frame is decoded into it and returned with release() after the corrected frame
+ * has been written. Slots are identified by their index, so that they can be passed through BoundedQueue<int>.
+ *
+ * All buffers are allocated in one page-aligned block when the pool is created, i.e. the memory use does not change
+ * during processing and no heap allocations are needed per frame. On Linux, the block can be backed by transparent
+ * huge pages, which reduces TLB misses for large frames.
+ *
+ * acquire() only waits for slots that are released by the last pipeline stage (the writer), which never waits for
+ * the first stage. Therefore the pool cannot deadlock as long as it has at least as many slots as frames can be in
+ * flight, and a smaller pool only limits the number of frames in flight.
+ */
+class FramePool {
+  public:
+    /**
+     * @param slotCount number of slots (>= 1)
+     * @param frameSize size of the frames. If it is empty (unknown), the buffers are allocated with the first frame
+     *                  that is decoded into each slot and reused from then on.
+     * @param frameFormat the format of the frames
+     * @param hugePages back the buffers with transparent huge pages if possible (Linux only)
+     */
+    FramePool(int slotCount, const cv::Size &frameSize, FrameFormat frameFormat, bool hugePages);
+    ~FramePool();
+
+    FramePool(const FramePool &) = delete;
+    FramePool &operator=(const FramePool &) = delete;
+
+    /**
+     * Checks out a free slot. Blocks while all slots are in use.
+     *
+     * @returns the index of the slot, or -1 if the pool has been closed
+     */
+    int acquire();
+
+    // Returns a slot that has been checked out with acquire().
+    void release(int slot);
+
+    // Wakes up all threads that are blocked in acquire(). From now on, acquire() fails.
+    void close();
+
+    cv::Mat &input(int slot);
+    cv::Mat &output(int slot);
+
+    int slotCount() const;
+
+    // Returns the number of bytes that have been preallocated for all slots.
+    size_t allocatedBytes() const;
+
+    // Returns true if the buffers are backed by huge pages (as far as the system has agreed to it).
+    bool usesHugePages() const;
+
+  private:
+    struct Slot {
+        cv::Mat input;
+        cv::Mat output;
+    };
+
+    std::vector<Slot> slots_;
+    std::vector<int> freeSlots_;
+    bool closed_ = false;
+    std::mutex mutex_;
+    std::condition_variable slotFree_;
+
+    uint8_t *memory_ = nullptr;
+    size_t allocatedBytes_ = 0;
+    size_t mappedBytes_ = 0; // including the alignment padding
+    bool hugePages_ = false;
+};
@@ -0,0 +1,61 @@
+#pragma once
+
+#include "FrameFormat.h"
+
+#include <opencv2/videoio.hpp>
+#include <string>
+
+struct AVCodecContext;
+struct AVFormatContext;
+struct AVFrame;
+struct AVPacket;
+struct SwsContext;
+
+/**
+ * Reads video frames directly with FFmpeg's libavformat/libavcodec instead of OpenCV's FFmpeg backend.
+ *
+ * Unlike cv::VideoCapture, this enables frame and slice threading in the decoder and converts each decoded frame
+ * straight into the Mat passed to retrieve() (no intermediate copy). Only available if vhs-deshaker was built with
+ * the FFmpeg libraries (HAVE_LIBAV). Frames can be retrieved as BGR24 or as planar YUV (see FrameFormat.h), which avoids
+ * the color conversion entirely for YUV input videos. Seeking to a frame is supported with set(cv::CAP_PROP_POS_FRAMES, ...).
+ */
+class LibavVideoCapture : public cv::VideoCapture {
+  public:
+    /**
+     * @param filename the input video file
+     * @param decoderThreads number of decoder threads, 0 = let FFmpeg choose based on the number of CPU cores
+     * @param frameFormat the format of the frames returned by retrieve()
+     */
+    LibavVideoCapture(const std::string &filename, int decoderThreads, FrameFormat frameFormat = FRAME_FORMAT_BGR24);
+    ~LibavVideoCapture() override;
+
+    bool isOpened() const override;
+
+    void release() override;
+
+    bool grab() override;
+
+    bool retrieve(cv::OutputArray image, int flag = 0) override;
+
+    double get(int propId) const override;
+
+    /**
+     * Only cv::CAP_PROP_POS_FRAMES is supported: seeks so that the next grab() returns the frame with the given index.
+     * Seeking is frame accurate, the frames between the preceding key frame and the target are decoded and dropped.
+     */
+    bool set(int propId, double value) override;
+
+  private:
+    bool seekToFrame(long frame);
+
+    AVFormatContext *formatContext_ = nullptr;
+    AVCodecContext *codecContext_ = nullptr;
+    SwsContext *swsContext_ = nullptr;
+    AVFrame *frame_ = nullptr;
+    AVPacket *packet_ = nullptr;
+    FrameFormat frameFormat_;
+    int streamIndex_ = -1;
+    bool flushing_ = false;
+    bool seekedFramePending_ = false; // the frame decoded by seekToFrame has not been returned by grab() yet
+    long framesGrabbed_ = 0;
+};
@@ -0,0 +1,98 @@
+#pragma once
+
+#include "FrameFormat.h"
+
+#include <opencv2/videoio.hpp>
+#include <string>
+#include <vector>
+
+struct AVCodecContext;
+struct AVFormatContext;
+struct AVFrame;
+struct AVPacket;
+struct AVStream;
+struct AVRational;
+struct SwsContext;
+
+/**
+ * Writes video frames directly with FFmpeg's libavformat/libavcodec instead of OpenCV's FFmpeg backend.
+ *
+ * Unlike cv::VideoWriter (which is limited to a fourcc and the encoder defaults), any FFmpeg encoder can be used,
+ * encoder options can be passed and the encoder may use several threads. The audio, subtitle and timecode streams of
+ * the input file can be copied into the output file without re-encoding. Only available if vhs-deshaker was built
+ * with the FFmpeg libraries (HAVE_LIBAV).
+ */
+class LibavVideoWriter : public cv::VideoWriter {
+  public:
+    /**
+     * @param filename the output video file (the container format is derived from the extension)
+     * @param codec an FFmpeg encoder name (e.g. "ffv1" or "libx264") or one of the shortcuts of resolve_encoder_name()
+     * @param encoderOptions encoder options as comma separated key=value pairs (e.g. "preset=slow,crf=18"), may be empty.
+     *                       The pixel format of the encoded video can be selected with pixel_format=<name>. By default,
+     *                       HuffYUV encodes yuv422p (like OpenCV's HFYU writer) and other encoders the supported format
+     *                       that is closest to frameFormat.
+     * @param encoderThreads number of encoder threads, 0 = let FFmpeg choose based on the number of CPU cores
+     * @param fps frame rate of the output video
+     * @param frameSize size of the frames
+     * @param frameFormat the format of the frames passed to write()
+     * @param copyStreamsFrom if not empty, the audio, subtitle and timecode streams of this file are copied packet by
+     *                        packet into the output file. Their timestamps are aligned to the video frames, i.e. they
+     *                        are scaled if fps differs from the frame rate of the file. In that case, the audio streams
+     *                        are not copied (see getWarnings), because the audio is not resampled.
+     */
+    LibavVideoWriter(const std::string &filename, const std::string &codec, const std::string &encoderOptions, int encoderThreads,
+                     double fps, const cv::Size &frameSize, FrameFormat frameFormat, const std::string &copyStreamsFrom = "");
+    ~LibavVideoWriter() override;
+
+    bool isOpened() const override;
+
+    void release() override;
+
+    void write(cv::InputArray image) override;
+
+    /**
+     * Returns a description of the last error (e.g. why the writer could not be opened), or an empty string.
+     */
+    const std::string &getLastError() const;
+
+    // Returns the number of streams that are copied from the file given by copyStreamsFrom.
+    int getCopiedStreamCount() const;
+
+    // Returns descriptions of the streams of copyStreamsFrom that cannot be copied (e.g. not supported by the container).
+    const std::vector<std::string> &getWarnings() const;
+
+    /**
+     * Maps the shortcuts accepted by --codec to FFmpeg encoder names ("x264" -> "libx264", "x265" -> "libx265").
+     * Other names are returned unchanged.
+     */
+    static std::string resolve_encoder_name(const std::string &codec);
+
+  private:
+    void fail(const std::string &message, int error = 0);
+    bool openCopiedStreams(const std::string &filename, const AVRational &frameRate);
+    void writePackets();
+    void copyPackets(int64_t until);
+    void freeContexts();
+
+    AVFormatContext *formatContext_ = nullptr;
+    AVCodecContext *codecContext_ = nullptr;
+    AVStream *stream_ = nullptr;
+    SwsContext *swsContext_ = nullptr;
+    AVFrame *frame_ = nullptr;
+    AVPacket *packet_ = nullptr;
+    FrameFormat frameFormat_;
+    cv::Size frameSize_;
+    long framesWritten_ = 0;
+    bool headerWritten_ = false;
+    std::string lastError_;
+
+    // Demuxer for the streams that are copied from the input file.
+    AVFormatContext *copyContext_ = nullptr;
+    AVPacket *copyPacket_ = nullptr;
+    bool copyPacketPending_ = false;
+    std::vector<int> copiedStreams_; // output stream index for each stream of copyContext_, -1 = not copied
+    int copyTimeScaleNum_ = 1; // input frame rate / output frame rate
+    int copyTimeScaleDen_ = 1;
+    int64_t copyStartTime_ = 0; // start time of the input's video stream (AV_TIME_BASE units)
+    std::vector<std::string> warnings_;
+};
@@ -0,0 +1,151 @@
+#pragma once
+
+#include "DeshakeContext.h"
+
+#include <cstdint>
+#include <fstream>
+#include <opencv2/core.hpp>
+#include <string>
+#include <vector>
+
+/*
+ * Line-starts files store the line starts of all frames of a video, so that the detection (analyze_frame) and the
+ * shifting (shift_frame) can be run separately. They can also be written by external tools.
+ *
+ * Layout (all values in little-endian byte order):
+ * - LineStartsFileHeader
+ * - one record per frame: int16 arrays with one element per row of the frame, in this order:
+ *   - the final line starts (merged, gap-filled and smoothed)
+ *   - the raw line starts and raw line ends (only if LINE_STARTS_FILE_RAW is set)
+ *   - the segment sizes of the line starts and line ends (only if LINE_STARTS_FILE_SEGMENT_SIZES is set)
+ * - the frame index: one uint64 file offset per frame, pointing to the frame's record
+ *
+ * Unknown line starts are stored as LINE_STARTS_FILE_MISSING.
+ */
+
+const char LINE_STARTS_FILE_MAGIC[8] = {'V', 'H', 'S', 'L', 'I', 'N', 'E', 'S'};
+const uint32_t LINE_STARTS_FILE_VERSION = 1;
+
+// Flags of LineStartsFileHeader::flags.
+const uint32_t LINE_STARTS_FILE_RAW = 0x1;
+const uint32_t LINE_STARTS_FILE_SEGMENT_SIZES = 0x2;
+
+const int16_t LINE_STARTS_FILE_MISSING = INT16_MIN;
+
+struct LineStartsFileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t flags;
+    int32_t frameWidth;
+    int32_t frameHeight; // number of rows per frame
+    uint32_t frameCount;
+    uint32_t reserved;
+    uint64_t indexOffset; // file offset of the frame index
+};
+
+/**
+ * Writes a line-starts file (see above). The frame index and the frame count are written by close().
+ */
+class LineStartsWriter {
+  public:
+    /**
+     * Creates the file and writes a preliminary header. Does not throw, errors (including an unsupported frame size)
+     * are reported by isOpened() and getLastError().
+     *
+     * @param filename the line-starts file to create
+     * @param frameSize size of the frames (of the Y plane for planar YUV frames), at most 32767x32767
+     * @param flags LINE_STARTS_FILE_* flags that select the optional arrays of each record
+     */
+    LineStartsWriter(const std::string &filename, const cv::Size &frameSize, uint32_t flags);
+    ~LineStartsWriter();
+
+    LineStartsWriter(const LineStartsWriter &) = delete;
+    LineStartsWriter &operator=(const LineStartsWriter &) = delete;
+
+    bool isOpened() const;
+
+    /**
+     * Appends the line starts of a frame that has been analyzed with analyze_frame. If LINE_STARTS_FILE_RAW is set,
+     * context.keepRawLineStarts must have been set as well.
+     *
+     * @returns false if the record could not be written (see getLastError)
+     */
+    bool write(const DeshakeContext &context);
+
+    /**
+     * Writes the frame index, completes the header and closes the file. Called by the destructor if necessary.
+     *
+     * @returns false if the file could not be completed (see getLastError)
+     */
+    bool close();
+
+    uint32_t getFrameCount() const;
+
+    uint32_t getFlags() const;
+
+    // Returns a description of the last error, or an empty string.
+    const std::string &getLastError() const;
+
+  private:
+    void append(const std::vector<int> &values);
+    bool fail(const std::string &message);
+
+    std::ofstream file_;
+    LineStartsFileHeader header_;
+    std::vector<int16_t> record_;
+    std::vector<uint64_t> index_;
+    uint64_t offset_ = 0;
+    std::string lastError_;
+};
+
+/**
+ * Reads a line-starts file (see above). The file is memory-mapped (read into memory on Windows), so the line starts
+ * of any frame can be read without seeking.
+ */
+class LineStartsReader {
+  public:
+    /**
+     * Opens and validates the file (header, frame index and the size of all records).
+     */
+    explicit LineStartsReader(const std::string &filename);
+    ~LineStartsReader();
+
+    LineStartsReader(const LineStartsReader &) = delete;
+    LineStartsReader &operator=(const LineStartsReader &) = delete;
+
+    bool isOpened() const;
+
+    uint32_t getFrameCount() const;
+
+    // Returns the frame size the line starts were detected for (the number of line starts per frame is its height).
+    cv::Size getFrameSize() const;
+
+    uint32_t getFlags() const;
+
+    /**
+     * Reads the final line starts of a frame. Unknown line starts are returned as INT_MIN (like correct_frame's).
+     *
+     * @param frame index of the frame (< getFrameCount())
+     * @param line_starts receives one line start per row, resized to the frame height (no allocation if it already has
+     *                    that size)
+     */
+    void readLineStarts(uint32_t frame, std::vector<int> &line_starts) const;
+
+    // Returns a description of the last error (e.g. why the file is invalid), or an empty string.
+    const std::string &getLastError() const;
+
+  private:
+    bool fail(const std::string &message);
+    uint64_t getRecordOffset(uint32_t frame) const;
+    void unmap();
+
+    const uint8_t *data_ = nullptr;
+    size_t size_ = 0;
+#ifdef _WIN32
+    std::vector<uint8_t> buffer_;
+#endif
+    LineStartsFileHeader header_;
+    size_t recordBytes_ = 0;
+    bool opened_ = false;
+    std::string lastError_;
+};
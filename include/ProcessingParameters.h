@@ -1,12 +1,22 @@
 #pragma once
 
+#include "FrameFormat.h"
+
 struct ProcessingParameters {
+    // Line starts are detected by computing the grayscale value of the border pixels on the fly (no grayscale copy is made).
+    static const int SCAN_METHOD_FUSED = 0;
+    // Line starts are detected on grayscale copies of the left and right borders (made with cv::cvtColor).
+    static const int SCAN_METHOD_GRAY = 1;
+
     static const int DEFAULT_COL_RANGE = -1;
     static const int DEFAULT_TARGET_LINE_START = -1;
     static const int DEFAULT_PURE_BLACK_WIDTH = 8;
     static const int DEFAULT_PURE_BLACK_THRESHOLD = 20;
     static const int DEFAULT_MIN_LINE_START_SEGMENT_LENGTH = 15;
     static const int DEFAULT_LINE_START_SMOOTHING_KERNEL_SIZE = 51;
+    static const int DEFAULT_SCAN_METHOD = SCAN_METHOD_FUSED;
+    static const int DEFAULT_TEMPORAL_SEARCH_WINDOW = 0;
+    static const bool DEFAULT_DETECT_DUPLICATE_FRAMES = false;
 
     /*
      * @brief The number of columns to the left and right of the video frames that are used for the line-start detection.
@@ -31,4 +41,24 @@ struct ProcessingParameters {
 
     // line starts are smoothed with a normalized blurring filter of this size.
     int lineStartSmoothingKernelSize = DEFAULT_LINE_START_SMOOTHING_KERNEL_SIZE;
+
+    // the method used to scan the left- and right-hand borders for line starts (one of the SCAN_METHOD_* constants).
+    // Both methods detect the same line starts.
+    int scanMethod = DEFAULT_SCAN_METHOD;
+
+    // if > 0, the borders of each frame are only searched within this many columns around the line starts of the previous
+    // frame (temporal prior). Rows where the edge is not found in this window are scanned fully, and the prior is dropped
+    // after a scene change. Requires that the frames are processed in order by one DeshakeContext.
+    int temporalSearchWindow = DEFAULT_TEMPORAL_SEARCH_WINDOW;
+
+    // if true, the line-start detection is skipped for frames whose left and right borders are identical to the previous
+    // frame's (paused playback, black frames, duplicate frames of the capture device). The line starts only depend on the
+    // borders, so the line starts of the previous frame are reused without changing the result. Off by default: copying
+    // and comparing the borders costs time for every frame and only pays off if the input has many repeated frames.
+    // Requires that the frames are processed in order by one DeshakeContext (not supported by process_multi_threaded).
+    bool detectDuplicateFrames = DEFAULT_DETECT_DUPLICATE_FRAMES;
+
+    // the pixel format of the frames (see FrameFormat.h). For planar YUV formats, the line starts are detected on the Y plane
+    // (pureBlackThreshold is mapped to the limited range of the Y values).
+    int frameFormat = FRAME_FORMAT_BGR24;
 };
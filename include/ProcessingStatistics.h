@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstddef>
+
+/**
+ * Statistics of a processing run, printed in the end-of-run summary.
+ */
+struct ProcessingStatistics {
+    // number of frames that have been written
+    long framesWritten = 0;
+
+    // Capacity and high-water marks of the queues between the decoder, the frame correction and the writer
+    // (0 if the respective queue is not used). A high-water mark that reaches the capacity means that the next stage
+    // could not keep up at some point, e.g. a full write queue means that the encoder is the bottleneck.
+    size_t readQueueCapacity = 0;
+    size_t readQueueHighWaterMark = 0;
+    size_t writeQueueCapacity = 0;
+    size_t writeQueueHighWaterMark = 0;
+
+    // Number of slots and preallocated bytes of the frame pool (0 bytes if the frame size was unknown in advance).
+    int framePoolSlots = 0;
+    size_t framePoolBytes = 0;
+    bool framePoolHugePages = false;
+
+    // Border searches that used the temporal prior (ProcessingParameters::temporalSearchWindow), how many of them fell
+    // back to a full scan, and how often the prior was dropped because of a scene change.
+    long temporalWindowRows = 0;
+    long temporalFallbackRows = 0;
+    long temporalPriorResets = 0;
+
+    // Number of frames whose borders were identical to the previous frame's, so that the line-start detection was
+    // skipped (ProcessingParameters::detectDuplicateFrames).
+    long duplicateFrames = 0;
+};
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+/**
+ * The stages whose durations are measured when profiling is enabled. The decoding and encoding are measured by the
+ * process_* functions, the other stages by correct_frame (analyze_frame and shift_frame).
+ */
+enum ProfileStage {
+    PROFILE_STAGE_DECODE = 0,
+    PROFILE_STAGE_ANALYZE,   // analyze_frame (the stages up to smooth)
+    PROFILE_STAGE_CVT_COLOR, // grayscale copies of the borders (SCAN_METHOD_GRAY only)
+    PROFILE_STAGE_SCAN,      // raw line starts of both borders
+    PROFILE_STAGE_DENOISE,
+    PROFILE_STAGE_MERGE,
+    PROFILE_STAGE_FILL_GAPS,
+    PROFILE_STAGE_SMOOTH,
+    PROFILE_STAGE_SHIFT, // shift_frame
+    PROFILE_STAGE_ENCODE,
+    PROFILE_STAGE_COUNT
+};
+
+// Returns the name of the stage in the profile report, e.g. "fill_gaps".
+const char *profile_stage_name(ProfileStage stage);
+
+/**
+ * Enables or disables the profiling (disabled by default). Must be called before the processing starts. While
+ * disabled, a ProfileScope only costs a check of this flag.
+ */
+void set_profiling_enabled(bool enabled);
+
+bool is_profiling_enabled();
+
+/**
+ * Records a duration of a stage. Each thread records into its own accumulator, so no locking is needed.
+ */
+void record_profile_sample(ProfileStage stage, std::chrono::nanoseconds duration);
+
+/**
+ * Measures the time from its construction to its destruction with a monotonic clock and records it for the stage (if
+ * profiling is enabled).
+ */
+class ProfileScope {
+  public:
+    explicit ProfileScope(ProfileStage stage) : stage_(stage), enabled_(is_profiling_enabled()) {
+        if (enabled_) {
+            start_ = std::chrono::steady_clock::now();
+        }
+    }
+
+    ~ProfileScope() {
+        if (enabled_) {
+            record_profile_sample(stage_, std::chrono::steady_clock::now() - start_);
+        }
+    }
+
+    ProfileScope(const ProfileScope &) = delete;
+    ProfileScope &operator=(const ProfileScope &) = delete;
+
+  private:
+    ProfileStage stage_;
+    bool enabled_;
+    std::chrono::steady_clock::time_point start_;
+};
+
+/**
+ * Writes the samples of all threads as a JSON report: for each stage that has been measured, the number of samples, the
+ * total time and the mean, p50 and p99 latencies. Must only be called when no other thread records samples anymore.
+ *
+ * @returns false if the file cannot be written
+ */
+bool write_profile_report(const std::string &filename);
@@ -0,0 +1,64 @@
+#pragma once
+
+#include "FrameFormat.h"
+
+#include <opencv2/videoio.hpp>
+#include <string>
+#include <vector>
+
+/**
+ * Reads video frames from stdin, the counterpart of StdoutVideoWriter.
+ *
+ * Two stream types are supported:
+ * - YUV4MPEG2 (Y4M) streams, which are detected by their signature. The frame size, frame rate and pixel format
+ *   (4:2:0 or 4:2:2) are taken from the stream header.
+ * - Headerless raw frames. The frame size and pixel format must be given to the constructor, the frame rate is unknown.
+ *
+ * retrieve() reads each frame with one large read directly into the caller's buffer (only the few KB that stdio has
+ * already buffered are copied). Therefore a grabbed frame can only be retrieved once, and retrieve() fails if the
+ * stream ends within the frame.
+ */
+class StdinVideoReader : public cv::VideoCapture {
+  public:
+    /**
+     * @param rawFrameSize frame size of raw input (ignored for Y4M input)
+     * @param rawFrameFormat pixel format of raw input (ignored for Y4M input)
+     */
+    StdinVideoReader(const cv::Size &rawFrameSize, FrameFormat rawFrameFormat);
+
+    bool isOpened() const override;
+
+    void release() override;
+
+    bool grab() override;
+
+    bool retrieve(cv::OutputArray image, int flag = 0) override;
+
+    double get(int propId) const override;
+
+    // Returns true if the input is a Y4M stream.
+    bool isY4M() const;
+
+    // Returns the pixel format of the frames returned by retrieve().
+    FrameFormat getFrameFormat() const;
+
+    // Returns a description of the last error (e.g. why the input could not be opened), or an empty string.
+    const std::string &getLastError() const;
+
+  private:
+    bool readBytes(void *data, size_t count);
+    bool skipBytes(size_t count);
+    bool readLine(std::string &line);
+    bool parseY4MHeader(const std::string &header);
+
+    cv::Size frameSize_;
+    FrameFormat frameFormat_;
+    double fps_ = 0;
+    bool y4m_ = false;
+    bool opened_ = false;
+    long framesGrabbed_ = 0;
+    bool frameGrabbed_ = false; // true if the data of the grabbed frame has not been read yet
+    size_t frameBytes_ = 0;
+    std::vector<uint8_t> pending_; // bytes that were read to detect the stream type and belong to the first frame
+    std::string lastError_;
+};
@@ -1,10 +1,28 @@
 #pragma once
 
+#include "FrameFormat.h"
+
 #include <opencv2/videoio.hpp>
+#include <string>
 
+/**
+ * Writes the frames to stdout, either as raw frames (in the format they are passed to write()) or as a YUV4MPEG2 (Y4M)
+ * stream.
+ *
+ * In Y4M mode, the stream header is written before the first frame, and each frame is preceded by a "FRAME" marker.
+ * Planar YUV frames are written as they are, BGR frames are converted to YUV 4:2:0.
+ *
+ * On Linux, the frames are written with write()/writev() on the file descriptor of stdout instead of fwrite(), i.e.
+ * without copying them into the stdio buffer, and if stdout is a pipe, the pipe buffer is enlarged to hold a whole frame.
+ */
 class StdoutVideoWriter : public cv::VideoWriter {
   public:
-    StdoutVideoWriter();
+    /**
+     * @param frameFormat the format of the frames passed to write()
+     * @param y4m write a Y4M stream instead of raw frames
+     * @param fps frame rate for the Y4M stream header (ignored for raw frames)
+     */
+    explicit StdoutVideoWriter(FrameFormat frameFormat = FRAME_FORMAT_BGR24, bool y4m = false, double fps = 0);
 
     void write(cv::InputArray image) override;
 
@@ -14,8 +32,22 @@ class StdoutVideoWriter : public cv::VideoWriter {
 
     long getTotalWritten() const;
 
+    // Returns the size of the pipe buffer of stdout, or 0 if stdout is not a pipe (or the size is unknown).
+    int getPipeSize() const;
+
   private:
+    void writeBytes(const void *prefix, size_t prefixCount, const void *data, size_t count);
+    void enlargePipe(size_t frameBytes);
+    void writeY4MHeader(const cv::Size &frameSize);
+
+    FrameFormat frameFormat;
+    bool y4m;
+    double fps;
+    bool headerWritten = false;
+    cv::Mat yuvBuffer; // BGR frames converted to YUV 4:2:0 (Y4M mode only)
     long totalWritten = 0;
+    bool firstWrite = true;
+    int pipeSize = 0;
 #if 0
     std::ofstream ofile; // For debugging
 #endif
@@ -3,6 +3,7 @@
 #include <opencv2/core.hpp>
 #include <vector>
 
+#include "DeshakeContext.h"
 #include "ProcessingParameters.h"
 
 /**
@@ -10,16 +11,36 @@
  * to realign the rows so that they start at the same x-position / column. This fixes mild to medium cases
  * of horizontal shaking and distortions caused by lack of TBC.
  *
- * @param input The input frame (BGR).
+ * @param input The input frame (BGR or planar YUV, see ProcessingParameters::frameFormat).
  * @param parameters See ProcessingParameters.h.
- * @param grayBuffer1 A Mat that can be reused as buffer for the grayscale version of the input frame (left border).
- * @param grayBuffer1 A Mat that can be reused as buffer for the grayscale version of the input frame (right border).
- * @param line_starts_buffer A vector that can be reused as buffer to store line starts.
- * @param line_ends_buffer A vector that can be reused as buffer to store line ends.
- * @param out The corrected output frame (BGR).
+ * @param context Scratch state that is reused between calls (see DeshakeContext.h). Holds the final line starts of the
+ *                frame after the call.
+ * @param out The corrected output frame (same format as the input frame).
  */
-void correct_frame(cv::Mat &input, const ProcessingParameters &parameters, cv::Mat &grayBuffer1, cv::Mat &grayBuffer2,
-                   std::vector<int> &line_starts_buffer, std::vector<int> &line_ends_buffer, cv::Mat &out);
+void correct_frame(const cv::Mat &input, const ProcessingParameters &parameters, DeshakeContext &context, cv::Mat &out);
+
+/**
+ * The detection part of correct_frame: scans the borders for raw line starts, denoises, merges, fills the gaps and
+ * smoothes them. Nothing is shifted.
+ *
+ * @param input The input frame (BGR or planar YUV, see ProcessingParameters::frameFormat).
+ * @param parameters See ProcessingParameters.h.
+ * @param context Scratch state that is reused between calls (see DeshakeContext.h). Holds the final line starts, the
+ *                segment sizes and (if requested) the raw line starts of the frame after the call.
+ */
+void analyze_frame(const cv::Mat &input, const ProcessingParameters &parameters, DeshakeContext &context);
+
+/**
+ * The shifting part of correct_frame: shifts each row of the frame so that its line start moves to
+ * parameters.targetLineStart.
+ *
+ * @param input The input frame (BGR or planar YUV, see ProcessingParameters::frameFormat).
+ * @param line_starts The line start of each row (e.g. computed by analyze_frame), INT_MIN for rows that are not shifted.
+ *                    Must have one element per row of the frame (the Y plane for planar YUV frames).
+ * @param parameters See ProcessingParameters.h.
+ * @param out The corrected output frame (same format as the input frame).
+ */
+void shift_frame(const cv::Mat &input, const std::vector<int> &line_starts, const ProcessingParameters &parameters, cv::Mat &out);
 
 /**
  * Draw line starts into an image frame for debugging purposes.
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <climits>
+#include <cstdint>
+#include <opencv2/core.hpp>
+#include <vector>
+
+#include "DeshakeContext.h"
+#include "ProcessingParameters.h"
+
+/*
+ * The stages of correct_frame (see correct_frame.cpp for their documentation). They are not part of the interface of
+ * correct_frame.h, but the benchmarks and tests call them directly, and other modules need the constants.
+ */
+
+// Marks rows whose line start is unknown.
+const int MISSING = INT_MIN;
+
+// The scan direction of get_raw_line_starts: from the left-hand edge of the frame, or from the right-hand edge.
+const int DIRECTION_LEFT_TO_RIGHT = 1;
+const int DIRECTION_RIGHT_TO_LEFT = -1;
+
+void check_input(const cv::Mat &input, const ProcessingParameters &parameters);
+void get_raw_line_starts(const cv::Mat &strip, const ProcessingParameters &parameters, std::vector<int> &line_starts, int direction,
+                         const cv::Range &rows, const std::vector<int> *prior = nullptr, std::vector<uint8_t> *fallbacks = nullptr);
+int find_raw_line_start_in_window(const uint8_t *row, int cols, bool is_gray, uint8_t threshold, int direction, int expected, int window);
+void update_temporal_statistics(DeshakeContext &context);
+bool borders_match_previous_frame(const cv::Mat &leftBorder, const cv::Mat &rightBorder, DeshakeContext &context);
+void denoise_line_starts(const int minSegmentLength, std::vector<int> &line_starts, std::vector<int> &segment_sizes);
+void merge_line_starts_adv(const std::vector<int> &line_starts1, const std::vector<int> &line_starts2, std::vector<int> &segment_sizes1,
+                           std::vector<int> &segment_sizes2, std::vector<int> &merged, int &merged_from_starts_count,
+                           int &merged_from_ends_count);
+bool fill_gaps_in_line_starts(std::vector<int> &line_starts);
+bool extrapolate_line_starts(std::vector<int> &line_starts);
+void interpolate_line_starts(std::vector<int> &line_starts);
+void smooth_line_starts(std::vector<int> &line_starts, int kernelSize, std::vector<int> &buffer);
+void shift_rows(const cv::Mat &input, const std::vector<int> &line_starts, const ProcessingParameters &parameters, cv::Mat &out,
+                const cv::Range &rows);
+uint8_t get_scan_threshold(const ProcessingParameters &parameters);
+void shift_row(const uint8_t *input_row, uint8_t *output_row, int cols, int pixel_size, int line_start, int target_line_start,
+               uint8_t fill);
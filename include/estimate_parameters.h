@@ -0,0 +1,91 @@
+#pragma once
+#include "ProcessingParameters.h"
+#include <opencv2/videoio.hpp>
+#include <vector>
+
+// Default number of sample frames, and percentile of the line-start distances used to estimate the column range.
+const int DEFAULT_SAMPLE_FRAMES = 50;
+const double DEFAULT_COL_RANGE_PERCENTILE = 99.9;
+
+// Number of outermost columns on each side whose luminance is collected by estimate_parameters.
+const int BORDER_LUMA_COLUMNS = 2;
+
+// Percentile of the border luminance that is considered noise of the pure black, and the margin that is added to it to
+// get the pure black threshold (used by estimate_parameters).
+const double BORDER_LUMA_PERCENTILE = 98;
+const int PURE_BLACK_THRESHOLD_MARGIN = 6;
+
+// Pure black thresholds above this value mean that the borders of the sample frames are not black.
+const int MAX_ESTIMATED_PURE_BLACK_THRESHOLD = 100;
+
+struct ColRangeEstimate {
+    // the estimated column range, -1 if no line starts were found in the sample frames
+    int colRange = -1;
+
+    // the number of sample frames and raw line starts (of both sides) that the estimate is based on
+    int sampledFrames = 0;
+    long lineStarts = 0;
+
+    // the column range that would be needed to cover all line starts found in the sample frames
+    int maxColRange = -1;
+};
+
+struct ParameterEstimate {
+    // the recommended parameters: the given parameters with colRange, targetLineStart, pureBlackWidth and
+    // pureBlackThreshold replaced by the estimates. Only valid if valid is true.
+    ProcessingParameters parameters;
+    bool valid = false;
+
+    // the number of sample frames
+    int sampledFrames = 0;
+
+    // histogram of the luminance (full range 0-255) of the outermost BORDER_LUMA_COLUMNS columns on both sides of the
+    // sample frames, and its BORDER_LUMA_PERCENTILE percentile (the noise level of the pure black)
+    std::vector<long> borderLumaHistogram;
+    int borderLumaNoise = -1;
+
+    // histogram of the widths of the pure black borders (of both sides, index = width in pixels), as found by the
+    // line-start detection with the estimated pure black threshold
+    std::vector<long> borderWidthHistogram;
+    long lineStarts = 0;
+};
+
+/**
+ * Estimates the smallest column range (ProcessingParameters::colRange) that is big enough to find the line starts.
+ *
+ * The sample frames are spread evenly over the video. Their borders are scanned for raw line starts over half of the
+ * frame width. For each raw line start, the column range needed to find it is its distance from the border of the
+ * frame (plus one). The estimate is the given percentile of these distances, so that a few outliers (e.g. rows of
+ * dark scenes, where the line start is found deep inside the picture) do not inflate it.
+ *
+ * @param videoCapture the input video, must support seeking with cv::CAP_PROP_POS_FRAMES. Its position is undefined
+ *                     afterwards.
+ * @param parameters see ProcessingParameters.h (colRange is ignored)
+ * @param sample_frames number of frames to sample
+ * @param percentile percentage of the line starts that the estimated column range must cover (0-100)
+ * @returns the estimate, throws std::runtime_error if the video cannot be sampled
+ */
+ColRangeEstimate estimate_col_range(cv::VideoCapture &videoCapture, const ProcessingParameters &parameters,
+                                    int sample_frames = DEFAULT_SAMPLE_FRAMES,
+                                    double percentile = DEFAULT_COL_RANGE_PERCENTILE);
+
+/**
+ * Estimates the pure black threshold, the pure black width and the column range from sample frames of the video, so
+ * that they do not have to be found by trial and error.
+ *
+ * The sample frames are spread evenly over the video. They are decoded once and kept in memory for two steps:
+ * 1. The luminance of the outermost columns (which are pure black in VHS captures) is collected in a histogram. The
+ *    pure black threshold is its BORDER_LUMA_PERCENTILE percentile plus PURE_BLACK_THRESHOLD_MARGIN.
+ * 2. The borders are scanned for raw line starts with that threshold (like estimate_col_range). The pure black width
+ *    (and the target line start) is the median width of the black borders, the column range is estimated from the
+ *    same line starts.
+ *
+ * @param videoCapture the input video, must support seeking with cv::CAP_PROP_POS_FRAMES. Its position is undefined
+ *                     afterwards.
+ * @param parameters see ProcessingParameters.h (the other parameters are taken over into the recommended parameters)
+ * @param sample_frames number of frames to sample
+ * @returns the estimate (not valid if the borders are not black or no line starts are found), throws
+ *          std::runtime_error if the video cannot be sampled
+ */
+ParameterEstimate estimate_parameters(cv::VideoCapture &videoCapture, const ProcessingParameters &parameters,
+                                      int sample_frames = DEFAULT_SAMPLE_FRAMES);
@@ -0,0 +1,19 @@
+#pragma once
+#include "LineStartsFile.h"
+#include "ProcessingParameters.h"
+#include "ProcessingStatistics.h"
+#include <opencv2/videoio.hpp>
+
+/**
+ * Runs only the line-start detection of the VHS deshaking algorithm (analyze_frame function) on all frames of a video
+ * and writes the line starts of each frame to a line-starts file. The frames are neither shifted nor encoded, so this
+ * is much faster than a full pass. The line starts can later be applied with shift_frame.
+ *
+ * @param videoCapture input video frames are read from this object
+ * @param lineStartsWriter the line starts of each frame are written to this object
+ * @param parameters see ProcessingParameters.h
+ * @param print_progress if true, progress is printed for each 1000 frames
+ * @returns statistics of the run (framesWritten is the number of analyzed frames)
+ */
+ProcessingStatistics process_analyze_only(cv::VideoCapture &videoCapture, LineStartsWriter &lineStartsWriter,
+                                          const ProcessingParameters &parameters, bool print_progress);
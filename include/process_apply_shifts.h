@@ -0,0 +1,23 @@
+#pragma once
+#include "LineStartsFile.h"
+#include "ProcessingParameters.h"
+#include "ProcessingStatistics.h"
+#include <opencv2/videoio.hpp>
+
+/**
+ * Corrects all frames of a video with precomputed line starts (e.g. written by process_analyze_only) instead of
+ * detecting them, i.e. only the row shifting of the VHS deshaking algorithm (shift_frame function) is run.
+ *
+ * Throws std::runtime_error if the number of frames of the video does not match the line-starts file. The frame size
+ * must have been checked by the caller.
+ *
+ * @param videoCapture input video frames are read from this object
+ * @param videoWriter output video frames are written to this object
+ * @param lineStartsReader the line starts of each frame are read from this object
+ * @param parameters see ProcessingParameters.h (only targetLineStart and frameFormat are used)
+ * @param print_progress if true, progress is printed for each 1000 frames
+ * @returns statistics of the run
+ */
+ProcessingStatistics process_apply_shifts(cv::VideoCapture &videoCapture, cv::VideoWriter &videoWriter,
+                                          const LineStartsReader &lineStartsReader, const ProcessingParameters &parameters,
+                                          bool print_progress);
@@ -0,0 +1,23 @@
+#pragma once
+#include "ProcessingParameters.h"
+#include "ProcessingStatistics.h"
+#include <opencv2/videoio.hpp>
+
+/**
+ * Applies the VHS deshaking algorithm (correct_frame function) to all frames of a video using multiple threads.
+ *
+ * One thread decodes the input frames, a pool of worker threads corrects them and one thread writes the corrected
+ * frames in their original order. The output is identical to the output of process_single_threaded. The frame buffers
+ * are taken from a FramePool, i.e. they are allocated once.
+ *
+ * @param videoCapture input video frames are read from this object
+ * @param videoWriter output video frames are written to this object
+ * @param parameters see ProcessingParameters.h (temporalSearchWindow and detectDuplicateFrames are not supported)
+ * @param print_progress if true, progress is printed for each 1000 frames
+ * @param num_threads number of worker threads that correct frames in parallel (must be >= 1)
+ * @param huge_pages back the frame pool with transparent huge pages if possible (see FramePool)
+ * @returns statistics of the run (e.g. queue high-water marks)
+ */
+ProcessingStatistics process_multi_threaded(cv::VideoCapture &videoCapture, cv::VideoWriter &videoWriter,
+                                            const ProcessingParameters &parameters, bool print_progress, int num_threads,
+                                            bool huge_pages = false);
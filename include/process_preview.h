@@ -0,0 +1,47 @@
+#pragma once
+#include "ProcessingParameters.h"
+#include "ProcessingStatistics.h"
+#include <opencv2/videoio.hpp>
+#include <string>
+
+// Number of consecutive frames that are corrected at each preview position.
+const int DEFAULT_PREVIEW_BURST_FRAMES = 10;
+
+/**
+ * Returns the size of the preview frames written by process_preview for input frames of the given size (the input and
+ * the corrected frame side by side).
+ */
+cv::Size get_preview_frame_size(const cv::Size &frameSize);
+
+/**
+ * Returns true if filename has the extension of an image file (.png, .jpg, .jpeg, .bmp, .tif or .tiff), i.e. the preview
+ * should be written as an image grid (write_preview_grid) instead of a video (process_preview).
+ */
+bool is_preview_image_file(const std::string &filename);
+
+/**
+ * Corrects short bursts of frames at positions spread evenly over the video and writes each input frame and its
+ * corrected frame side by side. The positions are reached by seeking, so only positions * burst_frames frames are
+ * decoded. Each burst is corrected with a new DeshakeContext, because the frames of different bursts are not consecutive.
+ *
+ * @param videoCapture the input video, must support seeking with cv::CAP_PROP_POS_FRAMES
+ * @param videoWriter the preview frames (see get_preview_frame_size, same format as the input frames) are written to this object
+ * @param parameters see ProcessingParameters.h
+ * @param positions number of positions
+ * @param burst_frames number of consecutive frames that are corrected at each position
+ * @returns statistics of the run (framesWritten is the number of preview frames), throws std::runtime_error if the
+ *          video cannot be seeked
+ */
+ProcessingStatistics process_preview(cv::VideoCapture &videoCapture, cv::VideoWriter &videoWriter, const ProcessingParameters &parameters,
+                                     int positions, int burst_frames = DEFAULT_PREVIEW_BURST_FRAMES);
+
+/**
+ * Like process_preview, but only the last frame of each burst is kept. These preview frames are arranged in a grid,
+ * labeled with their frame numbers, and written as a single BGR image with cv::imwrite.
+ *
+ * @param image_file the image file (the format is chosen by its extension)
+ * @returns statistics of the run (framesWritten is the number of corrected frames), throws std::runtime_error if the
+ *          video cannot be seeked or the image cannot be written
+ */
+ProcessingStatistics write_preview_grid(cv::VideoCapture &videoCapture, const std::string &image_file, const ProcessingParameters &parameters,
+                                        int positions, int burst_frames = DEFAULT_PREVIEW_BURST_FRAMES);
@@ -1,14 +1,24 @@
 #pragma once
 #include "ProcessingParameters.h"
+#include "ProcessingStatistics.h"
 #include <opencv2/videoio.hpp>
 
 /**
  * Applies the VHS deshaking algorithm (correct_frame function) to all frames of a video.
  *
+ * The frames are corrected one after another by the calling thread. If queue_depth > 0, a read-ahead thread decodes
+ * the next frames and a write-behind thread encodes the corrected frames meanwhile, so that decoding and encoding
+ * overlap with the correction. The frame buffers are taken from a FramePool, i.e. they are allocated once.
+ *
  * @param videoCapture input video frames are read from this object
  * @param videoWriter output video frames are written to this object
  * @param parameters see ProcessingParameters.h
  * @param print_progress if true, progress is printed for each 1000 frames
+ * @param queue_depth maximum number of frames in the read-ahead and in the write-behind queue, 0 = read and write
+ *                    synchronously
+ * @param huge_pages back the frame pool with transparent huge pages if possible (see FramePool)
+ * @returns statistics of the run (e.g. queue high-water marks)
  */
-void process_single_threaded(cv::VideoCapture &videoCapture, cv::VideoWriter &videoWriter, const ProcessingParameters &parameters,
-                             bool print_progress);
+ProcessingStatistics process_single_threaded(cv::VideoCapture &videoCapture, cv::VideoWriter &videoWriter,
+                                             const ProcessingParameters &parameters, bool print_progress, int queue_depth,
+                                             bool huge_pages = false);
@@ -0,0 +1,82 @@
+#pragma once
+#include "ProcessingParameters.h"
+#include "ProcessingStatistics.h"
+#include <opencv2/videoio.hpp>
+#include <string>
+#include <vector>
+
+/**
+ * A parameter set of a sweep file.
+ *
+ * Sweep files are text files with one parameter set per line. Each line consists of whitespace-separated key=value pairs,
+ * where the keys are the long names of the commandline options for the line-start detection: colrange, target-line-start,
+ * pure-black-width, pure-black-threshold, min-line-start-segment-length, line-start-smoothing-kernel-size, scan-method
+ * and temporal-window. Parameters that are not given on a line are taken from the commandline. Empty lines and lines
+ * starting with '#' are ignored.
+ */
+struct SweepSet {
+    // the line of the sweep file (without surrounding whitespace)
+    std::string description;
+    ProcessingParameters parameters;
+};
+
+/**
+ * Statistics of one parameter set of a sweep.
+ */
+struct SweepStatistics {
+    long frames = 0;
+    long rows = 0;
+
+    // Sum and count of the distances between the raw line starts (and line ends) and the final line starts. This is the
+    // noise of the line-start detection as seen through the smoothing, not the jitter that is left in the output: it
+    // grows with the smoothing kernel size even if the output gets steadier, so it must not be used to rank kernel sizes.
+    double detectionNoiseSum = 0;
+    long detectionNoiseCount = 0;
+
+    // rows where neither a line start nor a line end was found, i.e. the shift of the row had to be interpolated
+    long missingRows = 0;
+
+    // rows where the left-hand (starts) or right-hand (ends) line start won the merge
+    long mergedFromStarts = 0;
+    long mergedFromEnds = 0;
+
+    long duplicateFrames = 0;
+
+    // Returns the mean detection noise in pixels.
+    double getDetectionNoise() const { return detectionNoiseCount > 0 ? detectionNoiseSum / detectionNoiseCount : 0; }
+
+    // Returns the fraction of rows without any line start (0-1).
+    double getMissingFraction() const { return rows > 0 ? static_cast<double>(missingRows) / rows : 0; }
+};
+
+/**
+ * Reads the parameter sets of a sweep file (see SweepSet).
+ *
+ * @param filename the sweep file
+ * @param defaults the parameters given on the commandline. colRange and targetLineStart may be -1 (derived from
+ *                 pureBlackWidth of each set).
+ * @returns the parameter sets, throws std::runtime_error with the line number if the file cannot be read or is invalid
+ */
+std::vector<SweepSet> read_sweep_file(const std::string &filename, const ProcessingParameters &defaults);
+
+/**
+ * Returns the name of the output video of the parameter set with the given index (starting at 1): the number is inserted
+ * before the extension of output_file, e.g. "deshaked.2.mkv".
+ */
+std::string get_sweep_output_file(const std::string &output_file, int index);
+
+/**
+ * Corrects all frames of a video with several parameter sets, so that the video only has to be decoded once. Each frame
+ * is corrected with all parameter sets in parallel (each set has its own DeshakeContext).
+ *
+ * @param videoCapture input video frames are read from this object
+ * @param sets the parameter sets
+ * @param videoWriters the corrected frames of each set are written to the writer with the same index. If empty, the
+ *                     frames are only analyzed (not shifted) to compute the statistics.
+ * @param print_progress if true, progress is printed for each 1000 frames
+ * @param set_statistics receives the statistics of each set
+ * @returns statistics of the run (framesWritten is the number of decoded frames)
+ */
+ProcessingStatistics process_sweep(cv::VideoCapture &videoCapture, const std::vector<SweepSet> &sets,
+                                   const std::vector<cv::VideoWriter *> &videoWriters, bool print_progress,
+                                   std::vector<SweepStatistics> &set_statistics);
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+// Number of rows that are processed at once by find_first_above_threshold_transposed.
+const int TRANSPOSED_TILE_ROWS = 32;
+
+// Fixed-point BGR to gray conversion weights of OpenCV's cv::cvtColor (0.114, 0.587 and 0.299 scaled by 2^14).
+const int LUMA_SHIFT = 14;
+const int LUMA_B = 1868;
+const int LUMA_G = 9617;
+const int LUMA_R = 4899;
+
+/**
+ * Returns the grayscale value (luma) of a BGR pixel, exactly as cv::cvtColor with COLOR_BGR2GRAY computes it.
+ */
+inline uint8_t bgr_to_luma(const uint8_t *bgr) {
+    return static_cast<uint8_t>((bgr[0] * LUMA_B + bgr[1] * LUMA_G + bgr[2] * LUMA_R + (1 << (LUMA_SHIFT - 1))) >> LUMA_SHIFT);
+}
+
+/**
+ * Returns the index of the first pixel in row[0..length) whose value is greater than threshold,
+ * or -1 if there is no such pixel.
+ *
+ * The implementation (AVX2, SSE2 or scalar) is chosen once at runtime based on the capabilities of the CPU.
+ */
+int find_first_above_threshold(const uint8_t *row, int length, uint8_t threshold);
+
+/**
+ * Returns the index of the last pixel in row[0..length) whose value is greater than threshold,
+ * or -1 if there is no such pixel.
+ *
+ * The implementation (AVX2, SSE2 or scalar) is chosen once at runtime based on the capabilities of the CPU.
+ */
+int find_last_above_threshold(const uint8_t *row, int length, uint8_t threshold);
+
+/**
+ * Returns the index of the first pixel in the BGR row bgr[0..3*length) whose luma is greater than threshold,
+ * or -1 if there is no such pixel.
+ *
+ * The luma is computed on the fly with the same fixed-point weights that cv::cvtColor uses for COLOR_BGR2GRAY,
+ * so the result is identical to converting the row to grayscale first and then calling find_first_above_threshold.
+ */
+int find_first_luma_above_threshold(const uint8_t *bgr, int length, uint8_t threshold);
+
+/**
+ * Returns the index of the last pixel in the BGR row bgr[0..3*length) whose luma is greater than threshold,
+ * or -1 if there is no such pixel. See find_first_luma_above_threshold.
+ */
+int find_last_luma_above_threshold(const uint8_t *bgr, int length, uint8_t threshold);
+
+/**
+ * Finds the first pixel above threshold in up to TRANSPOSED_TILE_ROWS rows at once.
+ *
+ * The pixels must be stored column-major in tile: the TRANSPOSED_TILE_ROWS bytes starting at
+ * tile[c * TRANSPOSED_TILE_ROWS] contain column c of all rows. This way a single vector comparison per column
+ * checks all rows, and the scan stops as soon as every row has been resolved. Only used by the transposed scan of the
+ * benchmarks (see correct_frame_bench.cpp), which is slower than the row-wise scan of correct_frame.
+ *
+ * @param tile      the column-major pixels, columns * TRANSPOSED_TILE_ROWS bytes
+ * @param columns   the number of columns in tile
+ * @param rows      the number of valid rows in tile (at most TRANSPOSED_TILE_ROWS), the remaining rows are ignored
+ * @param threshold see find_first_above_threshold
+ * @param first     receives for each of the valid rows the index of the first column with a pixel above threshold, or -1
+ */
+void find_first_above_threshold_transposed(const uint8_t *tile, int columns, int rows, uint8_t threshold, int *first);
+
+/**
+ * Returns the name of the scan kernel that has been chosen for this CPU ("avx2", "sse2" or "scalar").
+ */
+const char *scan_kernel_name();
+
+/**
+ * One implementation of the threshold scans, see find_first_above_threshold, find_last_above_threshold and
+ * find_first_above_threshold_transposed.
+ */
+struct ScanKernelVariant {
+    const char *name;
+    int (*findFirst)(const uint8_t *row, int length, uint8_t threshold);
+    int (*findLast)(const uint8_t *row, int length, uint8_t threshold);
+    // Returns a bit mask with one bit per row of a tile column (TRANSPOSED_TILE_ROWS bytes), set for the pixels above threshold.
+    uint32_t (*columnMask)(const uint8_t *column, uint8_t threshold);
+};
+
+/**
+ * Returns all implementations that this CPU supports, from the scalar one to the fastest one (which is the one used by
+ * the functions above). The others are only needed to test the implementations against each other.
+ */
+std::vector<ScanKernelVariant> get_scan_kernel_variants();
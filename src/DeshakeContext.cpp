@@ -0,0 +1,28 @@
+#include "DeshakeContext.h"
+
+void DeshakeContext::prepare(const cv::Size &frameSize, const ProcessingParameters &parameters) {
+    if (frameSize == frameSize_ && parameters.colRange == colRange_ && parameters.scanMethod == scanMethod_) {
+        return;
+    }
+
+    frameSize_ = frameSize;
+    colRange_ = parameters.colRange;
+    scanMethod_ = parameters.scanMethod;
+
+    lineStarts.resize(frameSize.height);
+    lineEnds.resize(frameSize.height);
+    segmentSizesStart.resize(frameSize.height);
+    segmentSizesEnd.resize(frameSize.height);
+    smoothingBuffer.resize(frameSize.height);
+
+    // The line starts of the previous frame are useless if the geometry has changed.
+    previousLineStarts.resize(frameSize.height);
+    temporalFallbacks.resize(frameSize.height);
+    hasPreviousLineStarts = false;
+    hasPreviousBorders = false;
+
+    if (parameters.scanMethod == ProcessingParameters::SCAN_METHOD_GRAY) {
+        grayBuffer1.create(frameSize.height, parameters.colRange, CV_8UC1);
+        grayBuffer2.create(frameSize.height, parameters.colRange, CV_8UC1);
+    }
+}
@@ -0,0 +1,83 @@
+#include "FrameFormat.h"
+
+#include <cassert>
+#include <stdexcept>
+
+bool is_planar_yuv(FrameFormat format) { return format == FRAME_FORMAT_YUV420P || format == FRAME_FORMAT_YUV422P; }
+
+int chroma_shift_x(FrameFormat format) { return is_planar_yuv(format) ? 1 : 0; }
+
+int chroma_shift_y(FrameFormat format) { return format == FRAME_FORMAT_YUV420P ? 1 : 0; }
+
+cv::Size get_frame_buffer_size(const cv::Size &frameSize, FrameFormat format) {
+    if (!is_planar_yuv(format)) {
+        return frameSize;
+    }
+
+    const int sx = chroma_shift_x(format);
+    const int sy = chroma_shift_y(format);
+    if (frameSize.width % (1 << sx) != 0 || frameSize.height % (1 << sy) != 0) {
+        throw std::invalid_argument(std::string("frame size is not compatible with the chroma subsampling of ") +
+                                    frame_format_name(format));
+    }
+
+    // The two chroma planes have (width >> sx) * (height >> sy) pixels each. Together, this is always a whole number
+    // of rows of width pixels with the supported subsamplings.
+    const int chroma_rows = 2 * (frameSize.height >> sy) * (frameSize.width >> sx) / frameSize.width;
+    return cv::Size(frameSize.width, frameSize.height + chroma_rows);
+}
+
+int get_frame_buffer_type(FrameFormat format) { return is_planar_yuv(format) ? CV_8UC1 : CV_8UC3; }
+
+void create_frame_buffer(cv::Mat &buffer, const cv::Size &frameSize, FrameFormat format) {
+    buffer.create(get_frame_buffer_size(frameSize, format), get_frame_buffer_type(format));
+}
+
+cv::Size get_frame_size(const cv::Mat &buffer, FrameFormat format) {
+    if (!is_planar_yuv(format)) {
+        return buffer.size();
+    }
+
+    // rows = height + 2 * height / 2^(sx + sy)
+    const int sx = chroma_shift_x(format);
+    const int sy = chroma_shift_y(format);
+    const int height = buffer.rows * (1 << (sx + sy)) / ((1 << (sx + sy)) + 2);
+    return cv::Size(buffer.cols, height);
+}
+
+cv::Mat get_plane(const cv::Mat &buffer, FrameFormat format, int plane) {
+    assert(is_planar_yuv(format));
+    assert(buffer.isContinuous());
+    assert(plane >= 0 && plane <= 2);
+
+    const cv::Size frameSize = get_frame_size(buffer, format);
+    if (plane == 0) {
+        return cv::Mat(frameSize, CV_8UC1, buffer.data);
+    }
+
+    const int chroma_width = frameSize.width >> chroma_shift_x(format);
+    const int chroma_height = frameSize.height >> chroma_shift_y(format);
+    uint8_t *data = buffer.data + frameSize.area() + (plane - 1) * chroma_width * chroma_height;
+    return cv::Mat(chroma_height, chroma_width, CV_8UC1, data);
+}
+
+bool parse_frame_format(const std::string &name, FrameFormat &format) {
+    for (FrameFormat candidate : {FRAME_FORMAT_BGR24, FRAME_FORMAT_YUV420P, FRAME_FORMAT_YUV422P}) {
+        if (name == frame_format_name(candidate)) {
+            format = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+const char *frame_format_name(FrameFormat format) {
+    switch (format) {
+    case FRAME_FORMAT_YUV420P:
+        return "yuv420p";
+    case FRAME_FORMAT_YUV422P:
+        return "yuv422p";
+    default:
+        return "bgr24";
+    }
+}
@@ -0,0 +1,124 @@
+#include "FramePool.h"
+
+#include <cassert>
+#include <cstdlib>
+#include <stdexcept>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+// Size of a transparent huge page on x86_64 and most aarch64 systems.
+const size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+
+size_t get_page_size() {
+#ifdef __linux__
+    return static_cast<size_t>(sysconf(_SC_PAGESIZE));
+#else
+    return 4096;
+#endif
+}
+
+size_t align_size(size_t size, size_t alignment) { return (size + alignment - 1) / alignment * alignment; }
+
+} // namespace
+
+FramePool::FramePool(int slotCount, const cv::Size &frameSize, FrameFormat frameFormat, bool hugePages) {
+    if (slotCount < 1) {
+        throw std::invalid_argument("slotCount must be >= 1");
+    }
+    slots_.resize(slotCount);
+    for (int i = slotCount - 1; i >= 0; --i) {
+        freeSlots_.push_back(i);
+    }
+
+    if (frameSize.empty()) {
+        return;
+    }
+
+    // Each buffer starts at a page boundary (or at a huge page boundary), so that the buffers of different slots
+    // never share a page.
+    const cv::Size buffer_size = get_frame_buffer_size(frameSize, frameFormat);
+    const int buffer_type = get_frame_buffer_type(frameFormat);
+    const size_t alignment = hugePages ? HUGE_PAGE_SIZE : get_page_size();
+    const size_t buffer_bytes = align_size(buffer_size.area() * CV_ELEM_SIZE(buffer_type), alignment);
+    allocatedBytes_ = 2 * slotCount * buffer_bytes;
+
+#ifdef __linux__
+    // mmap returns page-aligned memory. For huge pages, one huge page is added so that the block can be aligned.
+    mappedBytes_ = allocatedBytes_ + (hugePages ? HUGE_PAGE_SIZE : 0);
+    void *mapped = mmap(nullptr, mappedBytes_, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mapped == MAP_FAILED) {
+        throw std::bad_alloc();
+    }
+    memory_ = static_cast<uint8_t *>(mapped);
+    uint8_t *block = cv::alignPtr(memory_, static_cast<int>(alignment));
+#ifdef MADV_HUGEPAGE
+    hugePages_ = hugePages && madvise(block, allocatedBytes_, MADV_HUGEPAGE) == 0;
+#endif
+#else
+    (void)hugePages;
+    memory_ = static_cast<uint8_t *>(cv::fastMalloc(allocatedBytes_ + alignment));
+    uint8_t *block = cv::alignPtr(memory_, static_cast<int>(alignment));
+#endif
+
+    for (int i = 0; i < slotCount; ++i) {
+        slots_[i].input = cv::Mat(buffer_size, buffer_type, block + (2 * i) * buffer_bytes);
+        slots_[i].output = cv::Mat(buffer_size, buffer_type, block + (2 * i + 1) * buffer_bytes);
+    }
+}
+
+FramePool::~FramePool() {
+    // The Mats must not refer to the block anymore when it is freed (they do not own it).
+    slots_.clear();
+    if (memory_ != nullptr) {
+#ifdef __linux__
+        munmap(memory_, mappedBytes_);
+#else
+        cv::fastFree(memory_);
+#endif
+    }
+}
+
+int FramePool::acquire() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    slotFree_.wait(lock, [this] { return closed_ || !freeSlots_.empty(); });
+    if (closed_) {
+        return -1;
+    }
+
+    int slot = freeSlots_.back();
+    freeSlots_.pop_back();
+    return slot;
+}
+
+void FramePool::release(int slot) {
+    assert(slot >= 0 && slot < slotCount());
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        assert(freeSlots_.size() < slots_.size());
+        freeSlots_.push_back(slot);
+    }
+    slotFree_.notify_one();
+}
+
+void FramePool::close() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        closed_ = true;
+    }
+    slotFree_.notify_all();
+}
+
+cv::Mat &FramePool::input(int slot) { return slots_.at(slot).input; }
+
+cv::Mat &FramePool::output(int slot) { return slots_.at(slot).output; }
+
+int FramePool::slotCount() const { return static_cast<int>(slots_.size()); }
+
+size_t FramePool::allocatedBytes() const { return allocatedBytes_; }
+
+bool FramePool::usesHugePages() const { return hugePages_; }
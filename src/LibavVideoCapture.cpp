@@ -0,0 +1,225 @@
+#include "LibavVideoCapture.h"
+
+#include <cmath>
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libswscale/swscale.h>
+}
+
+namespace {
+
+AVPixelFormat to_av_pixel_format(FrameFormat format) {
+    switch (format) {
+    case FRAME_FORMAT_YUV420P:
+        return AV_PIX_FMT_YUV420P;
+    case FRAME_FORMAT_YUV422P:
+        return AV_PIX_FMT_YUV422P;
+    default:
+        return AV_PIX_FMT_BGR24;
+    }
+}
+
+} // namespace
+
+LibavVideoCapture::LibavVideoCapture(const std::string &filename, int decoderThreads, FrameFormat frameFormat)
+    : frameFormat_(frameFormat) {
+    // Keep FFmpeg quiet, like OPENCV_FFMPEG_LOGLEVEL=-8 does for OpenCV's FFmpeg backend (see main.cpp).
+    av_log_set_level(AV_LOG_QUIET);
+
+    if (avformat_open_input(&formatContext_, filename.c_str(), nullptr, nullptr) < 0) {
+        formatContext_ = nullptr;
+        return;
+    }
+    if (avformat_find_stream_info(formatContext_, nullptr) < 0) {
+        release();
+        return;
+    }
+
+#if LIBAVFORMAT_VERSION_MAJOR < 59
+    AVCodec *decoder = nullptr;
+#else
+    const AVCodec *decoder = nullptr;
+#endif
+    streamIndex_ = av_find_best_stream(formatContext_, AVMEDIA_TYPE_VIDEO, -1, -1, &decoder, 0);
+    if (streamIndex_ < 0 || decoder == nullptr) {
+        release();
+        return;
+    }
+
+    codecContext_ = avcodec_alloc_context3(decoder);
+    if (codecContext_ == nullptr ||
+        avcodec_parameters_to_context(codecContext_, formatContext_->streams[streamIndex_]->codecpar) < 0) {
+        release();
+        return;
+    }
+
+    // Lossless intra-only codecs like HuffYUV and FFV1 decode frames independently, so frame threading scales well.
+    // Codecs that support slices additionally decode each frame with several threads.
+    codecContext_->thread_count = decoderThreads;
+    codecContext_->thread_type = FF_THREAD_FRAME | FF_THREAD_SLICE;
+
+    if (avcodec_open2(codecContext_, decoder, nullptr) < 0) {
+        release();
+        return;
+    }
+
+    frame_ = av_frame_alloc();
+    packet_ = av_packet_alloc();
+    if (frame_ == nullptr || packet_ == nullptr) {
+        release();
+    }
+}
+
+LibavVideoCapture::~LibavVideoCapture() { release(); }
+
+bool LibavVideoCapture::isOpened() const { return codecContext_ != nullptr; }
+
+void LibavVideoCapture::release() {
+    sws_freeContext(swsContext_);
+    swsContext_ = nullptr;
+    av_packet_free(&packet_);
+    av_frame_free(&frame_);
+    avcodec_free_context(&codecContext_);
+    avformat_close_input(&formatContext_);
+    streamIndex_ = -1;
+}
+
+bool LibavVideoCapture::grab() {
+    if (!isOpened()) {
+        return false;
+    }
+    if (seekedFramePending_) {
+        seekedFramePending_ = false;
+        ++framesGrabbed_;
+        return true;
+    }
+
+    while (true) {
+        int ret = avcodec_receive_frame(codecContext_, frame_);
+        if (ret == 0) {
+            ++framesGrabbed_;
+            return true;
+        }
+        if (ret != AVERROR(EAGAIN)) {
+            // AVERROR_EOF (all frames have been returned) or a decoding error.
+            return false;
+        }
+
+        // The decoder needs more input.
+        if (flushing_) {
+            return false;
+        }
+        ret = av_read_frame(formatContext_, packet_);
+        if (ret < 0) {
+            // End of file: drain the frames that are still buffered in the decoder.
+            flushing_ = true;
+            avcodec_send_packet(codecContext_, nullptr);
+            continue;
+        }
+        if (packet_->stream_index == streamIndex_) {
+            ret = avcodec_send_packet(codecContext_, packet_);
+        }
+        av_packet_unref(packet_);
+        if (ret < 0 && ret != AVERROR(EAGAIN)) {
+            return false;
+        }
+    }
+}
+
+bool LibavVideoCapture::retrieve(cv::OutputArray image, int flag) {
+    if (!isOpened() || framesGrabbed_ == 0) {
+        return false;
+    }
+
+    // Convert the decoded frame straight into the (reused) output buffer. If the decoded frame already has the requested
+    // format (e.g. yuv422p from HuffYUV), swscale only copies the planes.
+    const int width = frame_->width;
+    const int height = frame_->height;
+    swsContext_ = sws_getCachedContext(swsContext_, width, height, static_cast<AVPixelFormat>(frame_->format), width, height,
+                                       to_av_pixel_format(frameFormat_), SWS_BICUBIC, nullptr, nullptr, nullptr);
+    if (swsContext_ == nullptr) {
+        return false;
+    }
+
+    cv::Mat &out = image.getMatRef();
+    create_frame_buffer(out, cv::Size(width, height), frameFormat_);
+    uint8_t *dst_data[4] = {out.data, nullptr, nullptr, nullptr};
+    int dst_linesize[4] = {static_cast<int>(out.step), 0, 0, 0};
+    if (is_planar_yuv(frameFormat_)) {
+        for (int plane = 0; plane < 3; ++plane) {
+            cv::Mat p = get_plane(out, frameFormat_, plane);
+            dst_data[plane] = p.data;
+            dst_linesize[plane] = static_cast<int>(p.step);
+        }
+    }
+    sws_scale(swsContext_, frame_->data, frame_->linesize, 0, height, dst_data, dst_linesize);
+    return true;
+}
+
+double LibavVideoCapture::get(int propId) const {
+    if (!isOpened()) {
+        return 0;
+    }
+
+    const AVStream *stream = formatContext_->streams[streamIndex_];
+    switch (propId) {
+    case cv::CAP_PROP_FRAME_WIDTH:
+        return codecContext_->width;
+    case cv::CAP_PROP_FRAME_HEIGHT:
+        return codecContext_->height;
+    case cv::CAP_PROP_FPS:
+        return av_q2d(av_guess_frame_rate(formatContext_, const_cast<AVStream *>(stream), nullptr));
+    case cv::CAP_PROP_FRAME_COUNT:
+        if (stream->nb_frames > 0) {
+            return static_cast<double>(stream->nb_frames);
+        }
+        // Estimate the frame count from the duration, like OpenCV does.
+        return std::floor(formatContext_->duration / static_cast<double>(AV_TIME_BASE) * get(cv::CAP_PROP_FPS) + 0.5);
+    case cv::CAP_PROP_POS_FRAMES:
+        return static_cast<double>(framesGrabbed_);
+    default:
+        return 0;
+    }
+}
+
+bool LibavVideoCapture::set(int propId, double value) {
+    if (!isOpened() || propId != cv::CAP_PROP_POS_FRAMES) {
+        return false;
+    }
+    return seekToFrame(static_cast<long>(value));
+}
+
+bool LibavVideoCapture::seekToFrame(long frame) {
+    AVStream *stream = formatContext_->streams[streamIndex_];
+    const AVRational frame_rate = av_guess_frame_rate(formatContext_, stream, nullptr);
+    if (frame < 0 || frame_rate.num <= 0 || frame_rate.den <= 0) {
+        return false;
+    }
+
+    // The timestamp of the frame, assuming a constant frame rate. Frames up to half a frame duration early are accepted.
+    const int64_t start_time = stream->start_time == AV_NOPTS_VALUE ? 0 : stream->start_time;
+    const AVRational frame_duration = av_inv_q(frame_rate);
+    const int64_t target = start_time + av_rescale_q(frame, frame_duration, stream->time_base);
+    const int64_t tolerance = av_rescale_q(1, frame_duration, stream->time_base) / 2;
+
+    // The demuxer seeks to the key frame before the target.
+    if (av_seek_frame(formatContext_, streamIndex_, target, AVSEEK_FLAG_BACKWARD) < 0) {
+        return false;
+    }
+    avcodec_flush_buffers(codecContext_);
+    flushing_ = false;
+    seekedFramePending_ = false;
+
+    do {
+        if (!grab()) {
+            return false;
+        }
+    } while (frame_->best_effort_timestamp != AV_NOPTS_VALUE && frame_->best_effort_timestamp < target - tolerance);
+
+    // The next grab() returns the frame that has just been decoded.
+    seekedFramePending_ = true;
+    framesGrabbed_ = frame;
+    return true;
+}
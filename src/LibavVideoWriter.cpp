@@ -0,0 +1,479 @@
+#include "LibavVideoWriter.h"
+
+#include <cstdint>
+#include <stdexcept>
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libavutil/opt.h>
+#include <libavutil/pixdesc.h>
+#include <libswscale/swscale.h>
+}
+
+namespace {
+
+// OpenCV's FFmpeg backend (used before the FFmpeg libraries were used directly) encodes HuffYUV as yuv422p. The default
+// output keeps this format, although the encoder also supports RGB formats.
+const AVPixelFormat HUFFYUV_PIXEL_FORMAT = AV_PIX_FMT_YUV422P;
+
+AVPixelFormat to_av_pixel_format(FrameFormat format) {
+    switch (format) {
+    case FRAME_FORMAT_YUV420P:
+        return AV_PIX_FMT_YUV420P;
+    case FRAME_FORMAT_YUV422P:
+        return AV_PIX_FMT_YUV422P;
+    default:
+        return AV_PIX_FMT_BGR24;
+    }
+}
+
+std::string error_string(int error) {
+    char buffer[AV_ERROR_MAX_STRING_SIZE] = {0};
+    av_strerror(error, buffer, sizeof(buffer));
+    return buffer;
+}
+
+/**
+ * Adds the defaults that make the supported codecs fast and lossless, unless the user has specified the respective
+ * options. FFV1 only encodes with several threads if the frames are split into slices (requires FFV1 version 3).
+ * x264 and x265 are lossy by default.
+ */
+void add_default_encoder_options(const std::string &encoder, AVDictionary **options) {
+    auto set_default = [options](const char *key, const char *value) {
+        if (av_dict_get(*options, key, nullptr, 0) == nullptr) {
+            av_dict_set(options, key, value, 0);
+        }
+    };
+    const bool quality_specified = av_dict_get(*options, "crf", nullptr, 0) != nullptr || av_dict_get(*options, "qp", nullptr, 0) != nullptr;
+
+    if (encoder == "ffv1") {
+        set_default("level", "3");
+        set_default("slices", "16");
+        set_default("slicecrc", "1");
+    } else if (encoder == "libx264" && !quality_specified) {
+        set_default("qp", "0");
+    } else if (encoder == "libx265" && !quality_specified) {
+        set_default("x265-params", "lossless=1");
+    }
+}
+
+} // namespace
+
+LibavVideoWriter::LibavVideoWriter(const std::string &filename, const std::string &codec, const std::string &encoderOptions,
+                                   int encoderThreads, double fps, const cv::Size &frameSize, FrameFormat frameFormat,
+                                   const std::string &copyStreamsFrom)
+    : frameFormat_(frameFormat), frameSize_(frameSize) {
+    const std::string encoder_name = resolve_encoder_name(codec);
+    const AVCodec *encoder = avcodec_find_encoder_by_name(encoder_name.c_str());
+    if (encoder == nullptr) {
+        fail("Encoder " + encoder_name + " is not available");
+        return;
+    }
+
+    int ret = avformat_alloc_output_context2(&formatContext_, nullptr, nullptr, filename.c_str());
+    if (ret < 0 || formatContext_ == nullptr) {
+        fail("Could not determine the container format of " + filename, ret);
+        return;
+    }
+
+    codecContext_ = avcodec_alloc_context3(encoder);
+    if (codecContext_ == nullptr) {
+        fail("Could not allocate the encoder");
+        return;
+    }
+
+    // The frames are numbered consecutively, i.e. the time base is the inverse of the frame rate
+    // (e.g. 30000/1001 for NTSC).
+    const AVRational frame_rate = av_d2q(fps, 100000);
+    codecContext_->width = frameSize.width;
+    codecContext_->height = frameSize.height;
+    codecContext_->time_base = av_inv_q(frame_rate);
+    codecContext_->framerate = frame_rate;
+    codecContext_->pix_fmt = AV_PIX_FMT_NONE;
+    codecContext_->thread_count = encoderThreads;
+    codecContext_->thread_type = FF_THREAD_FRAME | FF_THREAD_SLICE;
+    if (formatContext_->oformat->flags & AVFMT_GLOBALHEADER) {
+        codecContext_->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+    }
+
+    AVDictionary *options = nullptr;
+    ret = av_dict_parse_string(&options, encoderOptions.c_str(), "=", ",", 0);
+    if (ret < 0) {
+        av_dict_free(&options);
+        fail("Invalid encoder options: " + encoderOptions, ret);
+        return;
+    }
+    add_default_encoder_options(encoder_name, &options);
+
+    // Generic options (like pixel_format, slices or level) are applied to the codec context first, so that the pixel
+    // format is known before the encoder is opened. The remaining options are private options of the encoder.
+    ret = av_opt_set_dict(codecContext_, &options);
+    if (ret < 0) {
+        av_dict_free(&options);
+        fail("Invalid encoder options: " + encoderOptions, ret);
+        return;
+    }
+
+    // Without an explicit pixel format, the frames are encoded in their own format if the encoder supports it.
+    // Otherwise, the supported format that loses the least information is used. HuffYUV always uses yuv422p.
+    const AVPixelFormat source_format = to_av_pixel_format(frameFormat);
+    if (codecContext_->pix_fmt == AV_PIX_FMT_NONE) {
+        codecContext_->pix_fmt = source_format;
+        if (encoder_name == "huffyuv") {
+            codecContext_->pix_fmt = HUFFYUV_PIXEL_FORMAT;
+        } else if (encoder->pix_fmts != nullptr) {
+            codecContext_->pix_fmt = avcodec_find_best_pix_fmt_of_list(encoder->pix_fmts, source_format, 0, nullptr);
+        }
+    }
+
+    ret = avcodec_open2(codecContext_, encoder, &options);
+    if (ret < 0) {
+        av_dict_free(&options);
+        fail("Could not open encoder " + encoder_name, ret);
+        return;
+    }
+
+    // Options that have not been consumed by the encoder are most likely typos.
+    const AVDictionaryEntry *unused = av_dict_get(options, "", nullptr, AV_DICT_IGNORE_SUFFIX);
+    if (unused != nullptr) {
+        std::string key = unused->key;
+        av_dict_free(&options);
+        fail("Encoder " + encoder_name + " does not support the option " + key);
+        return;
+    }
+    av_dict_free(&options);
+
+    stream_ = avformat_new_stream(formatContext_, nullptr);
+    if (stream_ == nullptr) {
+        fail("Could not create the video stream");
+        return;
+    }
+    stream_->time_base = codecContext_->time_base;
+    stream_->avg_frame_rate = frame_rate;
+    ret = avcodec_parameters_from_context(stream_->codecpar, codecContext_);
+    if (ret < 0) {
+        fail("Could not create the video stream", ret);
+        return;
+    }
+    if (!copyStreamsFrom.empty() && !openCopiedStreams(copyStreamsFrom, frame_rate)) {
+        return;
+    }
+
+    if (!(formatContext_->oformat->flags & AVFMT_NOFILE)) {
+        ret = avio_open(&formatContext_->pb, filename.c_str(), AVIO_FLAG_WRITE);
+        if (ret < 0) {
+            fail("Could not open " + filename, ret);
+            return;
+        }
+    }
+    ret = avformat_write_header(formatContext_, nullptr);
+    if (ret < 0) {
+        fail("Could not write the header of " + filename, ret);
+        return;
+    }
+    headerWritten_ = true;
+
+    // The frame is converted into the encoder's pixel format (a plain copy if the formats match).
+    swsContext_ = sws_getContext(frameSize.width, frameSize.height, source_format, frameSize.width, frameSize.height,
+                                 codecContext_->pix_fmt, SWS_BICUBIC, nullptr, nullptr, nullptr);
+    frame_ = av_frame_alloc();
+    packet_ = av_packet_alloc();
+    if (swsContext_ == nullptr || frame_ == nullptr || packet_ == nullptr) {
+        fail("Could not allocate the frame buffers");
+        return;
+    }
+    frame_->format = codecContext_->pix_fmt;
+    frame_->width = frameSize.width;
+    frame_->height = frameSize.height;
+    ret = av_frame_get_buffer(frame_, 0);
+    if (ret < 0) {
+        fail("Could not allocate the frame buffers", ret);
+        return;
+    }
+}
+
+LibavVideoWriter::~LibavVideoWriter() {
+    try {
+        release();
+    } catch (const std::exception &) {
+        // The trailer could not be written. Nothing can be done about it in the destructor.
+    }
+}
+
+bool LibavVideoWriter::isOpened() const { return frame_ != nullptr && headerWritten_; }
+
+void LibavVideoWriter::release() {
+    if (isOpened()) {
+        // Drain the frames that are still buffered in the encoder, then finish the file.
+        try {
+            avcodec_send_frame(codecContext_, nullptr);
+            writePackets();
+            if (copyContext_ != nullptr) {
+                copyPackets(INT64_MAX);
+            }
+        } catch (...) {
+            freeContexts();
+            throw;
+        }
+        av_write_trailer(formatContext_);
+    }
+    freeContexts();
+}
+
+void LibavVideoWriter::write(cv::InputArray image) {
+    if (!isOpened()) {
+        throw std::runtime_error("LibavVideoWriter is not opened");
+    }
+
+    cv::Mat frame = image.getMat();
+    assert(get_frame_size(frame, frameFormat_) == frameSize_);
+
+    const uint8_t *src_data[4] = {frame.data, nullptr, nullptr, nullptr};
+    int src_linesize[4] = {static_cast<int>(frame.step), 0, 0, 0};
+    if (is_planar_yuv(frameFormat_)) {
+        for (int plane = 0; plane < 3; ++plane) {
+            cv::Mat p = get_plane(frame, frameFormat_, plane);
+            src_data[plane] = p.data;
+            src_linesize[plane] = static_cast<int>(p.step);
+        }
+    }
+
+    // The encoder may still reference the buffer of the previous frame (frame threading).
+    int ret = av_frame_make_writable(frame_);
+    if (ret < 0) {
+        throw std::runtime_error("Could not allocate frame buffer: " + error_string(ret));
+    }
+    sws_scale(swsContext_, src_data, src_linesize, 0, frameSize_.height, frame_->data, frame_->linesize);
+    frame_->pts = framesWritten_++;
+
+    ret = avcodec_send_frame(codecContext_, frame_);
+    if (ret < 0) {
+        throw std::runtime_error("Could not encode frame: " + error_string(ret));
+    }
+    writePackets();
+
+    // Copy the packets of the other streams up to the end of this frame. The muxer interleaves them with the video
+    // packets that the encoder has not returned yet.
+    if (copyContext_ != nullptr) {
+        copyPackets(av_rescale_q(framesWritten_, codecContext_->time_base, av_get_time_base_q()));
+    }
+}
+
+const std::string &LibavVideoWriter::getLastError() const { return lastError_; }
+
+int LibavVideoWriter::getCopiedStreamCount() const {
+    int count = 0;
+    for (int index : copiedStreams_) {
+        count += index >= 0 ? 1 : 0;
+    }
+    return count;
+}
+
+const std::vector<std::string> &LibavVideoWriter::getWarnings() const { return warnings_; }
+
+std::string LibavVideoWriter::resolve_encoder_name(const std::string &codec) {
+    if (codec == "x264") {
+        return "libx264";
+    }
+    if (codec == "x265") {
+        return "libx265";
+    }
+    return codec;
+}
+
+void LibavVideoWriter::fail(const std::string &message, int error) {
+    lastError_ = message;
+    if (error < 0) {
+        lastError_ += " (" + error_string(error) + ")";
+    }
+    freeContexts();
+}
+
+/**
+ * Opens filename with a separate demuxer and adds an output stream for each of its audio, subtitle and data streams.
+ * Must be called before the header is written.
+ *
+ * The first frame of the input's video stream becomes timestamp 0 of the output. If the output frame rate differs from
+ * the input frame rate (--framerate), the timestamps of the copied packets are scaled by the same factor as the video,
+ * so that each packet stays aligned to the video frame it belongs to.
+ */
+bool LibavVideoWriter::openCopiedStreams(const std::string &filename, const AVRational &frameRate) {
+    int ret = avformat_open_input(&copyContext_, filename.c_str(), nullptr, nullptr);
+    if (ret < 0) {
+        copyContext_ = nullptr;
+        fail("Could not open " + filename + " to copy its streams", ret);
+        return false;
+    }
+    ret = avformat_find_stream_info(copyContext_, nullptr);
+    if (ret < 0) {
+        fail("Could not read the streams of " + filename, ret);
+        return false;
+    }
+    copyPacket_ = av_packet_alloc();
+    if (copyPacket_ == nullptr) {
+        fail("Could not allocate the packet buffer");
+        return false;
+    }
+
+    const int video_index = av_find_best_stream(copyContext_, AVMEDIA_TYPE_VIDEO, -1, -1, nullptr, 0);
+    if (video_index >= 0) {
+        AVStream *video = copyContext_->streams[video_index];
+        if (video->start_time != AV_NOPTS_VALUE) {
+            copyStartTime_ = av_rescale_q(video->start_time, video->time_base, av_get_time_base_q());
+        }
+        const AVRational input_frame_rate = av_guess_frame_rate(copyContext_, video, nullptr);
+        if (input_frame_rate.num > 0 && input_frame_rate.den > 0) {
+            const AVRational scale = av_div_q(input_frame_rate, frameRate);
+            copyTimeScaleNum_ = scale.num;
+            copyTimeScaleDen_ = scale.den;
+        }
+
+        // Containers like MOV and MXF store the start timecode as metadata of the video stream.
+        const AVDictionaryEntry *timecode = av_dict_get(video->metadata, "timecode", nullptr, 0);
+        if (timecode != nullptr) {
+            av_dict_set(&stream_->metadata, "timecode", timecode->value, 0);
+        }
+    }
+    av_dict_copy(&formatContext_->metadata, copyContext_->metadata, 0);
+
+    copiedStreams_.assign(copyContext_->nb_streams, -1);
+    for (unsigned int i = 0; i < copyContext_->nb_streams; ++i) {
+        const AVStream *input = copyContext_->streams[i];
+        const AVMediaType type = input->codecpar->codec_type;
+        if (static_cast<int>(i) == video_index || (type != AVMEDIA_TYPE_AUDIO && type != AVMEDIA_TYPE_SUBTITLE && type != AVMEDIA_TYPE_DATA)) {
+            continue;
+        }
+
+        // Scaling the timestamps of audio packets does not change their samples, so the packet durations would not
+        // match the sample counts anymore (gaps or overlaps in most players). Changing the speed of the audio would
+        // require resampling it.
+        if (type == AVMEDIA_TYPE_AUDIO && copyTimeScaleNum_ != copyTimeScaleDen_) {
+            warnings_.push_back("Stream #" + std::to_string(i) + " (" + avcodec_get_name(input->codecpar->codec_id) +
+                                ") is not copied because the audio would have to be resampled for the changed frame rate");
+            continue;
+        }
+
+        // Data streams (e.g. timecode tracks) are only copied if the container is known to support them.
+        const int supported = avformat_query_codec(formatContext_->oformat, input->codecpar->codec_id, FF_COMPLIANCE_NORMAL);
+        if (supported == 0 || (supported < 0 && type == AVMEDIA_TYPE_DATA)) {
+            warnings_.push_back("Stream #" + std::to_string(i) + " (" + avcodec_get_name(input->codecpar->codec_id) +
+                                ") is not supported by the output container and is not copied");
+            continue;
+        }
+
+        AVStream *output = avformat_new_stream(formatContext_, nullptr);
+        if (output == nullptr) {
+            fail("Could not create the output stream for stream #" + std::to_string(i));
+            return false;
+        }
+        ret = avcodec_parameters_copy(output->codecpar, input->codecpar);
+        if (ret < 0) {
+            fail("Could not create the output stream for stream #" + std::to_string(i), ret);
+            return false;
+        }
+        // The codec tag of the input container may be invalid in the output container.
+        output->codecpar->codec_tag = 0;
+        output->time_base = input->time_base;
+        output->disposition = input->disposition;
+        av_dict_copy(&output->metadata, input->metadata, 0);
+        copiedStreams_[i] = output->index;
+    }
+    return true;
+}
+
+/**
+ * Writes all packets that the encoder has finished so far to the output file.
+ */
+void LibavVideoWriter::writePackets() {
+    while (true) {
+        int ret = avcodec_receive_packet(codecContext_, packet_);
+        if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
+            return;
+        }
+        if (ret < 0) {
+            throw std::runtime_error("Could not encode frame: " + error_string(ret));
+        }
+
+        av_packet_rescale_ts(packet_, codecContext_->time_base, stream_->time_base);
+        packet_->stream_index = stream_->index;
+        ret = av_interleaved_write_frame(formatContext_, packet_);
+        if (ret < 0) {
+            throw std::runtime_error("Could not write packet: " + error_string(ret));
+        }
+    }
+}
+
+/**
+ * Copies the packets of the copied streams to the output file until a packet starts after the given time
+ * (AV_TIME_BASE units of the output timeline). That packet is kept for the next call.
+ */
+void LibavVideoWriter::copyPackets(int64_t until) {
+    while (true) {
+        if (!copyPacketPending_) {
+            if (av_read_frame(copyContext_, copyPacket_) < 0) {
+                // End of file (or a broken file, which the video decoder reports itself).
+                return;
+            }
+            const int input_index = copyPacket_->stream_index;
+            if (input_index >= static_cast<int>(copiedStreams_.size()) || copiedStreams_[input_index] < 0) {
+                av_packet_unref(copyPacket_);
+                continue;
+            }
+
+            // Map the timestamps to the output timeline (see openCopiedStreams).
+            const AVStream *input = copyContext_->streams[input_index];
+            const AVStream *output = formatContext_->streams[copiedStreams_[input_index]];
+            const AVRational scaled_time_base = av_mul_q(input->time_base, AVRational{copyTimeScaleNum_, copyTimeScaleDen_});
+            const int64_t start = av_rescale_q(copyStartTime_, av_get_time_base_q(), input->time_base);
+            if (copyPacket_->pts != AV_NOPTS_VALUE) {
+                copyPacket_->pts = av_rescale_q(copyPacket_->pts - start, scaled_time_base, output->time_base);
+            }
+            if (copyPacket_->dts != AV_NOPTS_VALUE) {
+                copyPacket_->dts = av_rescale_q(copyPacket_->dts - start, scaled_time_base, output->time_base);
+            }
+            copyPacket_->duration = av_rescale_q(copyPacket_->duration, scaled_time_base, output->time_base);
+            copyPacket_->stream_index = output->index;
+            copyPacket_->pos = -1;
+
+            // Packets before the first video frame are dropped.
+            if (copyPacket_->pts != AV_NOPTS_VALUE && copyPacket_->pts < 0) {
+                av_packet_unref(copyPacket_);
+                continue;
+            }
+            copyPacketPending_ = true;
+        }
+
+        const AVStream *output = formatContext_->streams[copyPacket_->stream_index];
+        const int64_t timestamp = copyPacket_->dts != AV_NOPTS_VALUE ? copyPacket_->dts : copyPacket_->pts;
+        if (timestamp != AV_NOPTS_VALUE && av_rescale_q(timestamp, output->time_base, av_get_time_base_q()) > until) {
+            return;
+        }
+
+        copyPacketPending_ = false;
+        int ret = av_interleaved_write_frame(formatContext_, copyPacket_);
+        if (ret < 0) {
+            throw std::runtime_error("Could not write packet: " + error_string(ret));
+        }
+    }
+}
+
+void LibavVideoWriter::freeContexts() {
+    av_packet_free(&copyPacket_);
+    avformat_close_input(&copyContext_);
+    copyPacketPending_ = false;
+    sws_freeContext(swsContext_);
+    swsContext_ = nullptr;
+    av_packet_free(&packet_);
+    av_frame_free(&frame_);
+    avcodec_free_context(&codecContext_);
+    if (formatContext_ != nullptr) {
+        if (!(formatContext_->oformat->flags & AVFMT_NOFILE)) {
+            avio_closep(&formatContext_->pb);
+        }
+        avformat_free_context(formatContext_);
+        formatContext_ = nullptr;
+    }
+    stream_ = nullptr;
+    headerWritten_ = false;
+}
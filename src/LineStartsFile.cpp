@@ -0,0 +1,276 @@
+#include "LineStartsFile.h"
+#include "correct_frame_internal.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <stdexcept>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static_assert(sizeof(LineStartsFileHeader) == 40, "LineStartsFileHeader must not contain padding");
+
+namespace {
+
+int16_t to_int16(int value) {
+    if (value == MISSING) {
+        return LINE_STARTS_FILE_MISSING;
+    }
+    return static_cast<int16_t>(std::max(INT16_MIN + 1, std::min(value, static_cast<int>(INT16_MAX))));
+}
+
+// Returns the number of int16 arrays of each record.
+int get_array_count(uint32_t flags) {
+    int arrays = 1;
+    if (flags & LINE_STARTS_FILE_RAW) {
+        arrays += 2;
+    }
+    if (flags & LINE_STARTS_FILE_SEGMENT_SIZES) {
+        arrays += 2;
+    }
+    return arrays;
+}
+
+} // namespace
+
+LineStartsWriter::LineStartsWriter(const std::string &filename, const cv::Size &frameSize, uint32_t flags) {
+    memset(&header_, 0, sizeof(header_));
+    // Like the video writers, the constructor does not throw: the caller checks isOpened() and reports getLastError().
+    if (frameSize.width <= 0 || frameSize.height <= 0 || frameSize.width > INT16_MAX || frameSize.height > INT16_MAX) {
+        fail("Line-starts files support frame sizes between 1x1 and 32767x32767, not " + std::to_string(frameSize.width) + "x" +
+             std::to_string(frameSize.height));
+        return;
+    }
+    if ((flags & ~(LINE_STARTS_FILE_RAW | LINE_STARTS_FILE_SEGMENT_SIZES)) != 0) {
+        fail("Invalid line-starts file flags");
+        return;
+    }
+    memcpy(header_.magic, LINE_STARTS_FILE_MAGIC, sizeof(header_.magic));
+    header_.version = LINE_STARTS_FILE_VERSION;
+    header_.flags = flags;
+    header_.frameWidth = frameSize.width;
+    header_.frameHeight = frameSize.height;
+
+    record_.reserve(get_array_count(flags) * frameSize.height);
+
+    // The header is written again by close(), when the frame count and the offset of the index are known. The values
+    // are written as they are in memory, all supported platforms are little-endian.
+    file_.open(filename, std::ios::binary | std::ios::trunc);
+    if (!file_.write(reinterpret_cast<const char *>(&header_), sizeof(header_))) {
+        fail("Line-starts file " + filename + " cannot be created");
+        return;
+    }
+    offset_ = sizeof(header_);
+}
+
+LineStartsWriter::~LineStartsWriter() { close(); }
+
+bool LineStartsWriter::isOpened() const { return file_.is_open() && lastError_.empty(); }
+
+bool LineStartsWriter::write(const DeshakeContext &context) {
+    if (!isOpened()) {
+        return false;
+    }
+    if (static_cast<int>(context.lineStarts.size()) != header_.frameHeight) {
+        throw std::invalid_argument("number of line starts must match the frame height of the line-starts file");
+    }
+
+    record_.clear();
+    append(context.lineStarts);
+    if (header_.flags & LINE_STARTS_FILE_RAW) {
+        if (!context.keepRawLineStarts) {
+            throw std::invalid_argument("raw line starts are only available if keepRawLineStarts is set");
+        }
+        append(context.rawLineStarts);
+        append(context.rawLineEnds);
+    }
+    if (header_.flags & LINE_STARTS_FILE_SEGMENT_SIZES) {
+        append(context.segmentSizesStart);
+        append(context.segmentSizesEnd);
+    }
+
+    const size_t bytes = record_.size() * sizeof(int16_t);
+    if (!file_.write(reinterpret_cast<const char *>(record_.data()), bytes)) {
+        return fail("Line-starts file cannot be written");
+    }
+    index_.push_back(offset_);
+    offset_ += bytes;
+    return true;
+}
+
+bool LineStartsWriter::close() {
+    if (!file_.is_open()) {
+        return lastError_.empty();
+    }
+    if (!lastError_.empty()) {
+        file_.close();
+        return false;
+    }
+
+    header_.frameCount = static_cast<uint32_t>(index_.size());
+    header_.indexOffset = offset_;
+    file_.write(reinterpret_cast<const char *>(index_.data()), index_.size() * sizeof(uint64_t));
+    file_.seekp(0);
+    file_.write(reinterpret_cast<const char *>(&header_), sizeof(header_));
+    file_.close();
+    if (!file_) {
+        return fail("Line-starts file cannot be completed");
+    }
+    return true;
+}
+
+uint32_t LineStartsWriter::getFrameCount() const { return static_cast<uint32_t>(index_.size()); }
+
+uint32_t LineStartsWriter::getFlags() const { return header_.flags; }
+
+const std::string &LineStartsWriter::getLastError() const { return lastError_; }
+
+void LineStartsWriter::append(const std::vector<int> &values) {
+    assert(static_cast<int>(values.size()) == header_.frameHeight);
+    for (int value : values) {
+        record_.push_back(to_int16(value));
+    }
+}
+
+bool LineStartsWriter::fail(const std::string &message) {
+    lastError_ = message;
+    return false;
+}
+
+LineStartsReader::LineStartsReader(const std::string &filename) {
+    memset(&header_, 0, sizeof(header_));
+
+#ifdef _WIN32
+    std::ifstream file(filename, std::ios::binary | std::ios::ate);
+    if (!file) {
+        fail("Line-starts file " + filename + " cannot be opened");
+        return;
+    }
+    buffer_.resize(static_cast<size_t>(file.tellg()));
+    file.seekg(0);
+    if (!file.read(reinterpret_cast<char *>(buffer_.data()), buffer_.size())) {
+        fail("Line-starts file " + filename + " cannot be read");
+        return;
+    }
+    data_ = buffer_.data();
+    size_ = buffer_.size();
+#else
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd == -1) {
+        fail("Line-starts file " + filename + " cannot be opened");
+        return;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        void *mapped = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapped != MAP_FAILED) {
+            data_ = static_cast<const uint8_t *>(mapped);
+            size_ = static_cast<size_t>(st.st_size);
+            // The frames are usually read in order.
+            madvise(mapped, size_, MADV_SEQUENTIAL);
+        }
+    }
+    ::close(fd);
+    if (data_ == nullptr) {
+        fail("Line-starts file " + filename + " cannot be read");
+        return;
+    }
+#endif
+
+    // Validate the header, the index and the records, so that readLineStarts does not need any checks.
+    if (size_ < sizeof(header_)) {
+        fail("Invalid line-starts file (too short)");
+        return;
+    }
+    memcpy(&header_, data_, sizeof(header_));
+    if (memcmp(header_.magic, LINE_STARTS_FILE_MAGIC, sizeof(header_.magic)) != 0) {
+        fail("Invalid line-starts file (wrong signature)");
+        return;
+    }
+    if (header_.version != LINE_STARTS_FILE_VERSION) {
+        fail("Unsupported line-starts file version " + std::to_string(header_.version));
+        return;
+    }
+    if ((header_.flags & ~(LINE_STARTS_FILE_RAW | LINE_STARTS_FILE_SEGMENT_SIZES)) != 0) {
+        fail("Invalid line-starts file (unknown flags)");
+        return;
+    }
+    if (header_.frameWidth <= 0 || header_.frameHeight <= 0) {
+        fail("Invalid line-starts file (invalid frame size)");
+        return;
+    }
+    if (header_.indexOffset < sizeof(header_) || header_.indexOffset > size_ ||
+        (size_ - header_.indexOffset) / sizeof(uint64_t) < header_.frameCount) {
+        fail("Invalid line-starts file (frame index is missing or truncated)");
+        return;
+    }
+
+    recordBytes_ = get_array_count(header_.flags) * static_cast<size_t>(header_.frameHeight) * sizeof(int16_t);
+    for (uint32_t frame = 0; frame < header_.frameCount; ++frame) {
+        uint64_t offset = getRecordOffset(frame);
+        if (offset < sizeof(header_) || offset > header_.indexOffset || header_.indexOffset - offset < recordBytes_) {
+            fail("Invalid line-starts file (record of frame " + std::to_string(frame) + " is out of bounds)");
+            return;
+        }
+    }
+    opened_ = true;
+}
+
+LineStartsReader::~LineStartsReader() { unmap(); }
+
+bool LineStartsReader::isOpened() const { return opened_; }
+
+uint32_t LineStartsReader::getFrameCount() const { return header_.frameCount; }
+
+cv::Size LineStartsReader::getFrameSize() const { return cv::Size(header_.frameWidth, header_.frameHeight); }
+
+uint32_t LineStartsReader::getFlags() const { return header_.flags; }
+
+void LineStartsReader::readLineStarts(uint32_t frame, std::vector<int> &line_starts) const {
+    if (!opened_) {
+        throw std::logic_error("line-starts file is not open");
+    }
+    if (frame >= header_.frameCount) {
+        throw std::out_of_range("frame must be < number of frames in the line-starts file");
+    }
+
+    // Records written by other tools are not necessarily aligned, so the values are copied.
+    const uint8_t *record = data_ + getRecordOffset(frame);
+    line_starts.resize(header_.frameHeight);
+    for (int y = 0; y < header_.frameHeight; ++y) {
+        int16_t value;
+        memcpy(&value, record + y * sizeof(int16_t), sizeof(value));
+        line_starts[y] = value == LINE_STARTS_FILE_MISSING ? MISSING : value;
+    }
+}
+
+const std::string &LineStartsReader::getLastError() const { return lastError_; }
+
+bool LineStartsReader::fail(const std::string &message) {
+    lastError_ = message;
+    unmap();
+    return false;
+}
+
+uint64_t LineStartsReader::getRecordOffset(uint32_t frame) const {
+    uint64_t offset;
+    memcpy(&offset, data_ + header_.indexOffset + frame * sizeof(uint64_t), sizeof(offset));
+    return offset;
+}
+
+void LineStartsReader::unmap() {
+#ifdef _WIN32
+    buffer_.clear();
+#else
+    if (data_ != nullptr) {
+        munmap(const_cast<uint8_t *>(data_), size_);
+    }
+#endif
+    data_ = nullptr;
+    size_ = 0;
+}
@@ -0,0 +1,116 @@
+#include "Profiler.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace {
+
+std::atomic<bool> profiling_enabled(false);
+
+// The samples (durations in nanoseconds) of one thread, one vector per stage.
+struct ThreadSamples {
+    std::vector<int64_t> samples[PROFILE_STAGE_COUNT];
+};
+
+// The samples of all threads. They are owned here (not by the threads), so that they survive the threads until the
+// report is written.
+std::mutex threads_mutex;
+std::vector<std::unique_ptr<ThreadSamples>> threads;
+
+ThreadSamples &get_thread_samples() {
+    thread_local ThreadSamples *samples = nullptr;
+    if (samples == nullptr) {
+        std::lock_guard<std::mutex> lock(threads_mutex);
+        threads.emplace_back(new ThreadSamples());
+        samples = threads.back().get();
+    }
+    return *samples;
+}
+
+// Returns the given percentile of the (unsorted) samples in microseconds.
+double get_percentile_us(std::vector<int64_t> &samples, double percentile) {
+    const size_t index = std::min(samples.size() - 1, static_cast<size_t>(std::ceil(percentile / 100.0 * samples.size())) - 1);
+    std::nth_element(samples.begin(), samples.begin() + index, samples.end());
+    return samples[index] / 1000.0;
+}
+
+} // namespace
+
+const char *profile_stage_name(ProfileStage stage) {
+    switch (stage) {
+    case PROFILE_STAGE_DECODE:
+        return "decode";
+    case PROFILE_STAGE_ANALYZE:
+        return "analyze";
+    case PROFILE_STAGE_CVT_COLOR:
+        return "cvt_color";
+    case PROFILE_STAGE_SCAN:
+        return "scan";
+    case PROFILE_STAGE_DENOISE:
+        return "denoise";
+    case PROFILE_STAGE_MERGE:
+        return "merge";
+    case PROFILE_STAGE_FILL_GAPS:
+        return "fill_gaps";
+    case PROFILE_STAGE_SMOOTH:
+        return "smooth";
+    case PROFILE_STAGE_SHIFT:
+        return "shift";
+    case PROFILE_STAGE_ENCODE:
+        return "encode";
+    default:
+        return "unknown";
+    }
+}
+
+void set_profiling_enabled(bool enabled) { profiling_enabled = enabled; }
+
+bool is_profiling_enabled() { return profiling_enabled.load(std::memory_order_relaxed); }
+
+void record_profile_sample(ProfileStage stage, std::chrono::nanoseconds duration) {
+    get_thread_samples().samples[stage].push_back(duration.count());
+}
+
+bool write_profile_report(const std::string &filename) {
+    std::ofstream file(filename, std::ios::trunc);
+    if (!file) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(threads_mutex);
+    file << "{\n";
+    file << "  \"threads\": " << threads.size() << ",\n";
+    file << "  \"stages\": {";
+    bool first = true;
+    for (int stage = 0; stage < PROFILE_STAGE_COUNT; ++stage) {
+        std::vector<int64_t> samples;
+        for (const auto &thread : threads) {
+            samples.insert(samples.end(), thread->samples[stage].begin(), thread->samples[stage].end());
+        }
+        if (samples.empty()) {
+            continue;
+        }
+
+        int64_t total = 0;
+        for (int64_t sample : samples) {
+            total += sample;
+        }
+        file << (first ? "\n" : ",\n");
+        file << "    \"" << profile_stage_name(static_cast<ProfileStage>(stage)) << "\": {";
+        file << "\"count\": " << samples.size();
+        file << ", \"total_ms\": " << total / 1e6;
+        file << ", \"mean_us\": " << total / 1e3 / samples.size();
+        file << ", \"p50_us\": " << get_percentile_us(samples, 50);
+        file << ", \"p99_us\": " << get_percentile_us(samples, 99);
+        file << "}";
+        first = false;
+    }
+    file << "\n  }\n";
+    file << "}\n";
+    return static_cast<bool>(file);
+}
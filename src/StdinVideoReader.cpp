@@ -0,0 +1,251 @@
+#include "StdinVideoReader.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+
+namespace {
+
+const char Y4M_SIGNATURE[] = "YUV4MPEG2";
+const size_t Y4M_SIGNATURE_LENGTH = sizeof(Y4M_SIGNATURE) - 1;
+const size_t MAX_Y4M_HEADER_LENGTH = 1024;
+
+} // namespace
+
+StdinVideoReader::StdinVideoReader(const cv::Size &rawFrameSize, FrameFormat rawFrameFormat)
+    : frameSize_(rawFrameSize), frameFormat_(rawFrameFormat) {
+    // stdin keeps its default (small) stdio buffer: fread only reads past the buffer into the destination for requests
+    // larger than the buffer, so a bigger buffer would copy every frame once more (see readBytes).
+
+    // Y4M streams start with a signature. For raw input, the bytes read here belong to the first frame.
+    pending_.resize(Y4M_SIGNATURE_LENGTH);
+    pending_.resize(fread(pending_.data(), 1, pending_.size(), stdin));
+    if (pending_.size() == Y4M_SIGNATURE_LENGTH && memcmp(pending_.data(), Y4M_SIGNATURE, Y4M_SIGNATURE_LENGTH) == 0) {
+        pending_.clear();
+        std::string header;
+        if (!readLine(header)) {
+            lastError_ = "Invalid Y4M stream header";
+            return;
+        }
+        if (!parseY4MHeader(header)) {
+            return;
+        }
+        y4m_ = true;
+    } else if (pending_.empty()) {
+        lastError_ = "No data on stdin";
+        return;
+    } else if (frameSize_.width <= 0 || frameSize_.height <= 0) {
+        lastError_ = "Raw input from stdin requires the frame size (--size)";
+        return;
+    }
+
+    try {
+        frameBytes_ = get_frame_buffer_size(frameSize_, frameFormat_).area() * CV_ELEM_SIZE(get_frame_buffer_type(frameFormat_));
+    } catch (const std::invalid_argument &e) {
+        lastError_ = e.what();
+        return;
+    }
+    opened_ = true;
+}
+
+bool StdinVideoReader::isOpened() const { return opened_; }
+
+void StdinVideoReader::release() {
+    opened_ = false;
+    frameGrabbed_ = false;
+}
+
+bool StdinVideoReader::grab() {
+    if (!opened_) {
+        return false;
+    }
+
+    // The data of a frame that has been grabbed but not retrieved is skipped.
+    if (frameGrabbed_) {
+        frameGrabbed_ = false;
+        if (!skipBytes(frameBytes_)) {
+            return false;
+        }
+    }
+
+    // Each Y4M frame starts with "FRAME", optionally followed by frame parameters (which are ignored).
+    if (y4m_) {
+        std::string frame_header;
+        if (!readLine(frame_header)) {
+            return false;
+        }
+        if (frame_header.compare(0, 5, "FRAME") != 0) {
+            lastError_ = "Invalid Y4M frame header";
+            return false;
+        }
+    } else if (pending_.empty()) {
+        // Raw frames have no header, so only the end of the stream can be detected here.
+        int c = getc(stdin);
+        if (c == EOF) {
+            return false;
+        }
+        ungetc(c, stdin);
+    }
+
+    frameGrabbed_ = true;
+    ++framesGrabbed_;
+    return true;
+}
+
+bool StdinVideoReader::retrieve(cv::OutputArray image, int flag) {
+    if (!opened_ || !frameGrabbed_) {
+        return false;
+    }
+    frameGrabbed_ = false;
+
+    // The buffer is only allocated if image does not have the frame size and type yet (e.g. a FramePool slot has).
+    image.create(get_frame_buffer_size(frameSize_, frameFormat_), get_frame_buffer_type(frameFormat_));
+    cv::Mat frame = image.getMat();
+
+    // A truncated last frame is dropped.
+    if (frame.isContinuous()) {
+        return readBytes(frame.data, frameBytes_);
+    }
+    const size_t row_bytes = frame.cols * frame.elemSize();
+    for (int y = 0; y < frame.rows; ++y) {
+        if (!readBytes(frame.ptr(y), row_bytes)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+double StdinVideoReader::get(int propId) const {
+    switch (propId) {
+    case cv::CAP_PROP_FRAME_WIDTH:
+        return frameSize_.width;
+    case cv::CAP_PROP_FRAME_HEIGHT:
+        return frameSize_.height;
+    case cv::CAP_PROP_FPS:
+        return fps_;
+    case cv::CAP_PROP_POS_FRAMES:
+        return static_cast<double>(framesGrabbed_);
+    default:
+        // The frame count of a stream is unknown.
+        return 0;
+    }
+}
+
+bool StdinVideoReader::isY4M() const { return y4m_; }
+
+FrameFormat StdinVideoReader::getFrameFormat() const { return frameFormat_; }
+
+const std::string &StdinVideoReader::getLastError() const { return lastError_; }
+
+/**
+ * Reads exactly count bytes (first the pending bytes, then from stdin). Returns false if stdin ends before.
+ *
+ * For frames, count is much larger than the stdio buffer of stdin, so only the bytes that are already buffered (read
+ * ahead with a frame header) and the remainder of less than one buffer size are copied. The rest is read directly into
+ * data.
+ */
+bool StdinVideoReader::readBytes(void *data, size_t count) {
+    uint8_t *dst = static_cast<uint8_t *>(data);
+    if (!pending_.empty()) {
+        size_t n = std::min(count, pending_.size());
+        memcpy(dst, pending_.data(), n);
+        pending_.erase(pending_.begin(), pending_.begin() + n);
+        dst += n;
+        count -= n;
+    }
+    return fread(dst, 1, count, stdin) == count;
+}
+
+/**
+ * Reads and discards count bytes. Returns false if stdin ends before.
+ */
+bool StdinVideoReader::skipBytes(size_t count) {
+    uint8_t buffer[64 * 1024];
+    while (count > 0) {
+        const size_t n = std::min(count, sizeof(buffer));
+        if (!readBytes(buffer, n)) {
+            return false;
+        }
+        count -= n;
+    }
+    return true;
+}
+
+/**
+ * Reads a line (without the terminating '\n') of a Y4M header. Returns false if stdin ends or the line is too long.
+ */
+bool StdinVideoReader::readLine(std::string &line) {
+    line.clear();
+    while (line.size() < MAX_Y4M_HEADER_LENGTH) {
+        int c = getc(stdin);
+        if (c == EOF) {
+            return false;
+        }
+        if (c == '\n') {
+            return true;
+        }
+        line.push_back(static_cast<char>(c));
+    }
+    return false;
+}
+
+/**
+ * Parses the parameters of the Y4M stream header (everything after the signature), e.g. " W720 H576 F25:1 Ip A128:117 C422".
+ */
+bool StdinVideoReader::parseY4MHeader(const std::string &header) {
+    frameSize_ = cv::Size(0, 0);
+    frameFormat_ = FRAME_FORMAT_YUV420P;
+    fps_ = 0;
+
+    size_t begin = 0;
+    while (begin < header.size()) {
+        size_t end = header.find(' ', begin);
+        if (end == std::string::npos) {
+            end = header.size();
+        }
+        const std::string token = header.substr(begin, end - begin);
+        begin = end + 1;
+        if (token.empty()) {
+            continue;
+        }
+
+        const std::string value = token.substr(1);
+        switch (token[0]) {
+        case 'W':
+            frameSize_.width = atoi(value.c_str());
+            break;
+        case 'H':
+            frameSize_.height = atoi(value.c_str());
+            break;
+        case 'F': {
+            int num = 0, den = 0;
+            if (sscanf(value.c_str(), "%d:%d", &num, &den) == 2 && num > 0 && den > 0) {
+                fps_ = num / static_cast<double>(den);
+            }
+            break;
+        }
+        case 'C':
+            // Only 8 bit 4:2:0 (all chroma sample positions) and 4:2:2 are supported.
+            if (value == "420" || value == "420jpeg" || value == "420paldv" || value == "420mpeg2") {
+                frameFormat_ = FRAME_FORMAT_YUV420P;
+            } else if (value == "422") {
+                frameFormat_ = FRAME_FORMAT_YUV422P;
+            } else {
+                lastError_ = "Unsupported Y4M colorspace " + value + " (must be 4:2:0 or 4:2:2 with 8 bits)";
+                return false;
+            }
+            break;
+        default:
+            // Interlacing, pixel aspect ratio and comments are irrelevant for processing.
+            break;
+        }
+    }
+
+    if (frameSize_.width <= 0 || frameSize_.height <= 0) {
+        lastError_ = "Invalid Y4M stream header (frame size is missing)";
+        return false;
+    }
+    return true;
+}
@@ -1,6 +1,46 @@
 #include "StdoutVideoWriter.h"
 
-StdoutVideoWriter::StdoutVideoWriter() {
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <opencv2/imgproc.hpp>
+#include <stdexcept>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+/**
+ * Converts the frame rate to the fraction used in the Y4M header. NTSC rates (e.g. 29.97) are mapped to the exact
+ * fractions with the denominator 1001 (e.g. 30000:1001).
+ */
+void get_frame_rate_fraction(double fps, long &num, long &den) {
+    if (std::abs(fps - std::round(fps)) < 1e-6) {
+        num = std::lround(fps);
+        den = 1;
+    } else if (std::abs(std::round(fps * 1.001) / 1.001 - fps) < 0.005) {
+        num = std::lround(fps * 1.001) * 1000;
+        den = 1001;
+    } else {
+        num = std::lround(fps * 1000);
+        den = 1000;
+    }
+}
+
+#ifdef __linux__
+// Upper limit for the pipe buffer. Unprivileged processes are limited by /proc/sys/fs/pipe-max-size (1 MiB by default).
+const int MAX_PIPE_SIZE = 64 * 1024 * 1024;
+const int DEFAULT_PIPE_SIZE = 64 * 1024;
+#endif
+
+} // namespace
+
+StdoutVideoWriter::StdoutVideoWriter(FrameFormat frameFormat, bool y4m, double fps) : frameFormat(frameFormat), y4m(y4m), fps(fps) {
 #if 0
         // For debugging
         ofile.open("temp/StdoutVideoWriter.dat", std::ios::binary);
@@ -10,25 +50,144 @@ StdoutVideoWriter::StdoutVideoWriter() {
 void StdoutVideoWriter::write(cv::InputArray image) {
     cv::Mat frame = image.getMat();
     assert(!frame.empty());
-    assert(frame.type() == CV_8UC3);
-    int count = frame.cols * frame.rows * 3;
-    auto written = fwrite(frame.data, 1, count, stdout);
+    // BGR24 frames (CV_8UC3) or planar YUV frames (the planes stacked in a CV_8UC1 Mat, see FrameFormat.h).
+    assert(frame.type() == (is_planar_yuv(frameFormat) ? CV_8UC1 : CV_8UC3));
+    assert(frame.isContinuous());
+
+    if (firstWrite) {
+        firstWrite = false;
+        enlargePipe(frame.total() * frame.elemSize());
+    }
+
+    if (y4m) {
+        if (!headerWritten) {
+            writeY4MHeader(get_frame_size(frame, frameFormat));
+            headerWritten = true;
+        }
+
+        // Y4M has no BGR colorspace. OpenCV's I420 layout is the same as the layout of FRAME_FORMAT_YUV420P.
+        if (!is_planar_yuv(frameFormat)) {
+            cv::cvtColor(frame, yuvBuffer, cv::COLOR_BGR2YUV_I420);
+            frame = yuvBuffer;
+        }
+        writeBytes("FRAME\n", 6, frame.data, frame.total() * frame.elemSize());
+    } else {
+        writeBytes(nullptr, 0, frame.data, frame.total() * frame.elemSize());
+    }
+}
+
+void StdoutVideoWriter::release() { fflush(stdout); }
+
+bool StdoutVideoWriter::isOpened() const { return true; }
 
+long StdoutVideoWriter::getTotalWritten() const { return totalWritten; }
+
+int StdoutVideoWriter::getPipeSize() const { return pipeSize; }
+
+/**
+ * Writes prefix (may be empty) and data. On Linux, both are written with a single writev() call (if the pipe accepts
+ * everything at once).
+ */
+void StdoutVideoWriter::writeBytes(const void *prefix, size_t prefixCount, const void *data, size_t count) {
 #if 0
         // For debugging
-        ofile.write((const char *)frame.data, (size_t)frame.cols * frame.rows * 3);
+        ofile.write((const char *)prefix, (size_t)prefixCount);
+        ofile.write((const char *)data, (size_t)count);
 #endif
 
-    if (written != count) {
+#ifdef __linux__
+    struct iovec iov[2] = {{const_cast<void *>(prefix), prefixCount}, {const_cast<void *>(data), count}};
+    struct iovec *next = prefixCount > 0 ? iov : iov + 1;
+    int remaining_buffers = static_cast<int>(iov + 2 - next);
+    while (remaining_buffers > 0) {
+        ssize_t written = writev(STDOUT_FILENO, next, remaining_buffers);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw std::runtime_error(std::string("writev to stdout failed: ") + strerror(errno));
+        }
+        totalWritten += written;
+
+        // Skip the buffers that have been written completely and advance within the partially written one.
+        while (remaining_buffers > 0 && static_cast<size_t>(written) >= next->iov_len) {
+            written -= next->iov_len;
+            ++next;
+            --remaining_buffers;
+        }
+        if (remaining_buffers > 0) {
+            next->iov_base = static_cast<uint8_t *>(next->iov_base) + written;
+            next->iov_len -= written;
+        }
+    }
+#else
+    auto written = fwrite(prefix, 1, prefixCount, stdout) + fwrite(data, 1, count, stdout);
+    if (written != prefixCount + count) {
         assert(false);
         throw std::runtime_error("fwrite has not written all data");
     }
-
     totalWritten += written;
+#endif
 }
 
-void StdoutVideoWriter::release() { fflush(stdout); }
+/**
+ * If stdout is a pipe, enlarges its buffer so that it can hold a whole frame (Linux only). With the default size of
+ * 64 KiB, the writer blocks many times per frame until the reader has caught up.
+ */
+void StdoutVideoWriter::enlargePipe(size_t frameBytes) {
+#ifdef __linux__
+    // Data written with fwrite before (there should not be any) must not be overtaken by the write() calls.
+    fflush(stdout);
 
-bool StdoutVideoWriter::isOpened() const { return true; }
+    struct stat st;
+    if (fstat(STDOUT_FILENO, &st) != 0 || !S_ISFIFO(st.st_mode)) {
+        return;
+    }
 
-long StdoutVideoWriter::getTotalWritten() const { return totalWritten; }
\ No newline at end of file
+    // Try the smallest power of two that holds a frame, then smaller sizes if the limit of the system is lower.
+    int size = DEFAULT_PIPE_SIZE;
+    while (size < MAX_PIPE_SIZE && static_cast<size_t>(size) < frameBytes) {
+        size *= 2;
+    }
+    for (; size > DEFAULT_PIPE_SIZE; size /= 2) {
+        if (fcntl(STDOUT_FILENO, F_SETPIPE_SZ, size) >= 0) {
+            break;
+        }
+    }
+    pipeSize = fcntl(STDOUT_FILENO, F_GETPIPE_SZ);
+    if (pipeSize < 0) {
+        pipeSize = 0;
+    }
+#else
+    (void)frameBytes;
+#endif
+}
+
+/**
+ * Writes the Y4M stream header, e.g. "YUV4MPEG2 W720 H576 F25:1 I? A0:0 C420mpeg2". The interlacing and the pixel aspect
+ * ratio are unknown.
+ *
+ * 4:2:0 frames that have been decoded as such (MPEG-2, DV, H.264) have left-sited chroma (C420mpeg2), the default of
+ * these codecs. BGR frames are converted by cv::cvtColor, which averages 2x2 pixels, i.e. their chroma is centered
+ * (C420jpeg).
+ */
+void StdoutVideoWriter::writeY4MHeader(const cv::Size &frameSize) {
+    if (fps <= 0) {
+        throw std::invalid_argument("Y4M output requires the frame rate");
+    }
+    if (!is_planar_yuv(frameFormat) && (frameSize.width % 2 != 0 || frameSize.height % 2 != 0)) {
+        throw std::invalid_argument("Y4M output of BGR frames requires an even frame width and height");
+    }
+
+    long num, den;
+    get_frame_rate_fraction(fps, num, den);
+    const char *colorspace = "420jpeg";
+    if (frameFormat == FRAME_FORMAT_YUV422P) {
+        colorspace = "422";
+    } else if (frameFormat == FRAME_FORMAT_YUV420P) {
+        colorspace = "420mpeg2";
+    }
+    std::string header = "YUV4MPEG2 W" + std::to_string(frameSize.width) + " H" + std::to_string(frameSize.height) + " F" +
+                         std::to_string(num) + ":" + std::to_string(den) + " I? A0:0 C" + colorspace + "\n";
+    writeBytes(nullptr, 0, header.data(), header.size());
+}
\ No newline at end of file
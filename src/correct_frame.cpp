@@ -1,4 +1,9 @@
 #include "correct_frame.h"
+#include "Profiler.h"
+#include "correct_frame_internal.h"
+#include "scan_kernels.h"
+#include <algorithm>
+#include <cstring>
 #include <opencv2/imgproc.hpp>
 
 // #define ENABLE_VISUALIZATIONS
@@ -8,22 +13,71 @@
 
 using std::vector;
 
-// Internal helper methods.
-void get_raw_line_starts(const cv::Mat &gray, const ProcessingParameters &parameters, vector<int> &line_starts, int direction);
-void denoise_line_starts(const int minSegmentLength, vector<int> &line_starts, vector<int> &segment_sizes);
-void merge_line_starts_adv(const vector<int> &line_starts1, const vector<int> &line_starts2, vector<int> &segment_sizes1,
-                           vector<int> &segment_sizes2, vector<int> &merged, int &merged_from_starts_count, int &merged_from_ends_count);
-bool fill_gaps_in_line_starts(vector<int> &line_starts);
-bool extrapolate_line_starts(vector<int> &line_starts);
-void interpolate_line_starts(vector<int> &line_starts);
-
-const int MISSING = INT_MIN;
-const int DIRECTION_LEFT_TO_RIGHT = 1;
-const int DIRECTION_RIGHT_TO_LEFT = -1;
-
-void correct_frame(cv::Mat &input, const ProcessingParameters &parameters, cv::Mat &grayBuffer1, cv::Mat &grayBuffer2,
-                   vector<int> &line_starts_buffer, vector<int> &line_ends_buffer, cv::Mat &out) {
-    // Check parameters.
+// Row-wise stages of correct_frame are split into bands of this many rows that are processed in parallel.
+const int ROWS_PER_BAND = 64;
+
+namespace {
+
+// Scans row bands of the left- and right-hand borders for raw line starts (see get_raw_line_starts).
+class RawLineStartsScanner : public cv::ParallelLoopBody {
+  public:
+    RawLineStartsScanner(const cv::Mat &leftBorder, const cv::Mat &rightBorder, const ProcessingParameters &parameters,
+                         DeshakeContext &context)
+        : leftBorder_(leftBorder), rightBorder_(rightBorder), parameters_(parameters), context_(context) {}
+
+    void operator()(const cv::Range &rows) const override {
+        if (context_.hasPreviousLineStarts) {
+            // Temporal mode: the line starts of the previous frame tell where to search.
+            get_raw_line_starts(leftBorder_, parameters_, context_.lineStarts, DIRECTION_LEFT_TO_RIGHT, rows, &context_.previousLineStarts,
+                                &context_.temporalFallbacks);
+            get_raw_line_starts(rightBorder_, parameters_, context_.lineEnds, DIRECTION_RIGHT_TO_LEFT, rows, &context_.previousLineStarts,
+                                &context_.temporalFallbacks);
+        } else {
+            get_raw_line_starts(leftBorder_, parameters_, context_.lineStarts, DIRECTION_LEFT_TO_RIGHT, rows);
+            get_raw_line_starts(rightBorder_, parameters_, context_.lineEnds, DIRECTION_RIGHT_TO_LEFT, rows);
+        }
+    }
+
+  private:
+    const cv::Mat &leftBorder_;
+    const cv::Mat &rightBorder_;
+    const ProcessingParameters &parameters_;
+    DeshakeContext &context_;
+};
+
+// Shifts row bands of a frame (see shift_rows).
+class RowShifter : public cv::ParallelLoopBody {
+  public:
+    RowShifter(const cv::Mat &input, const vector<int> &line_starts, const ProcessingParameters &parameters, cv::Mat &out)
+        : input_(input), lineStarts_(line_starts), parameters_(parameters), out_(out) {}
+
+    void operator()(const cv::Range &rows) const override { shift_rows(input_, lineStarts_, parameters_, out_, rows); }
+
+  private:
+    const cv::Mat &input_;
+    const vector<int> &lineStarts_;
+    const ProcessingParameters &parameters_;
+    cv::Mat &out_;
+};
+
+} // namespace
+
+void correct_frame(const cv::Mat &input, const ProcessingParameters &parameters, DeshakeContext &context, cv::Mat &out) {
+    analyze_frame(input, parameters, context);
+    shift_frame(input, context.lineStarts, parameters, out);
+
+#ifdef ENABLE_VISUALIZATIONS
+    const FrameFormat format = static_cast<FrameFormat>(parameters.frameFormat);
+    cv::namedWindow("6 - out");
+    cv::imshow("6 - out", is_planar_yuv(format) ? get_plane(out, format, 0) : out);
+    cv::waitKey();
+#endif
+}
+
+/**
+ * Checks the parameters and that the input frame matches the frame format. Throws std::invalid_argument otherwise.
+ */
+void check_input(const cv::Mat &input, const ProcessingParameters &parameters) {
     if (parameters.colRange < 1) {
         throw std::invalid_argument("colRange must be >= 1");
     }
@@ -39,142 +93,300 @@ void correct_frame(cv::Mat &input, const ProcessingParameters &parameters, cv::M
     if (parameters.pureBlackThreshold < 0 || parameters.pureBlackThreshold > 255) {
         throw std::invalid_argument("pureBlackThreshold must be between 0 and 255");
     }
+    if (parameters.scanMethod != ProcessingParameters::SCAN_METHOD_FUSED && parameters.scanMethod != ProcessingParameters::SCAN_METHOD_GRAY) {
+        throw std::invalid_argument("scanMethod must be one of the SCAN_METHOD_* constants");
+    }
+    if (parameters.temporalSearchWindow < 0) {
+        throw std::invalid_argument("temporalSearchWindow must be >= 0");
+    }
+    const FrameFormat format = static_cast<FrameFormat>(parameters.frameFormat);
+    if (input.type() != (is_planar_yuv(format) ? CV_8UC1 : CV_8UC3) || !input.isContinuous()) {
+        throw std::invalid_argument("input frame does not match frameFormat");
+    }
+}
 
-    out.create(input.size(), input.type());
+void analyze_frame(const cv::Mat &input, const ProcessingParameters &parameters, DeshakeContext &context) {
+    ProfileScope analyze_scope(PROFILE_STAGE_ANALYZE);
+    check_input(input, parameters);
+
+    const FrameFormat format = static_cast<FrameFormat>(parameters.frameFormat);
+    const cv::Size frameSize = get_frame_size(input, format);
+    context.prepare(frameSize, parameters);
+
+    // The borders are scanned either directly (the grayscale value of each pixel is computed during the scan) or
+    // via grayscale copies. For planar YUV frames, the Y plane already is the grayscale image.
+    const cv::Mat luma = is_planar_yuv(format) ? get_plane(input, format, 0) : input;
+    cv::Mat leftBorder = luma.colRange(0, parameters.colRange);
+    cv::Mat rightBorder = luma.colRange(luma.cols - parameters.colRange, luma.cols);
+
+    // The line starts only depend on the borders. If they have not changed, the line starts in the context are still valid.
+    context.duplicateFrame = parameters.detectDuplicateFrames && borders_match_previous_frame(leftBorder, rightBorder, context);
+    if (context.duplicateFrame) {
+        context.temporalWindowRows = 0;
+        context.temporalFallbackRows = 0;
+        context.temporalPriorReset = false;
+        return;
+    }
+    if (parameters.detectDuplicateFrames) {
+        leftBorder.copyTo(context.previousLeftBorder);
+        rightBorder.copyTo(context.previousRightBorder);
+        context.hasPreviousBorders = true;
+    }
 
-    cv::cvtColor(input.colRange(0, parameters.colRange), grayBuffer1, cv::COLOR_BGR2GRAY);
-    cv::cvtColor(input.colRange(input.cols - parameters.colRange, input.cols), grayBuffer2, cv::COLOR_BGR2GRAY);
+    if (parameters.scanMethod == ProcessingParameters::SCAN_METHOD_GRAY && !is_planar_yuv(format)) {
+        ProfileScope scope(PROFILE_STAGE_CVT_COLOR);
+        cv::cvtColor(leftBorder, context.grayBuffer1, cv::COLOR_BGR2GRAY);
+        cv::cvtColor(rightBorder, context.grayBuffer2, cv::COLOR_BGR2GRAY);
+        leftBorder = context.grayBuffer1;
+        rightBorder = context.grayBuffer2;
+    }
 
-    vector<int> &line_starts = line_starts_buffer;
-    vector<int> &line_ends = line_ends_buffer;
-    get_raw_line_starts(grayBuffer1, parameters, line_starts, DIRECTION_LEFT_TO_RIGHT);
-    get_raw_line_starts(grayBuffer2, parameters, line_ends, DIRECTION_RIGHT_TO_LEFT);
+    // Every row is scanned independently, so both scans can be split into row bands that are processed in parallel.
+    const double num_bands = (frameSize.height + ROWS_PER_BAND - 1) / ROWS_PER_BAND;
+    vector<int> &line_starts = context.lineStarts;
+    vector<int> &line_ends = context.lineEnds;
+    const bool temporal = parameters.temporalSearchWindow > 0;
+    {
+        ProfileScope scope(PROFILE_STAGE_SCAN);
+        if (temporal && context.hasPreviousLineStarts) {
+            std::fill(context.temporalFallbacks.begin(), context.temporalFallbacks.end(), 0);
+        }
+        cv::parallel_for_(cv::Range(0, frameSize.height), RawLineStartsScanner(leftBorder, rightBorder, parameters, context), num_bands);
+        if (temporal) {
+            update_temporal_statistics(context);
+        }
+    }
+    if (context.keepRawLineStarts) {
+        // Assigning vectors of the same size does not allocate.
+        context.rawLineStarts = line_starts;
+        context.rawLineEnds = line_ends;
+    }
 
+#ifdef ENABLE_VISUALIZATIONS
     auto line_starts_raw = line_starts;
     auto line_ends_raw = line_ends;
-    vector<int> segment_sizes_start, segment_sizes_end;
-    denoise_line_starts(parameters.minLineStartSegmentLength, line_starts, segment_sizes_start);
-    denoise_line_starts(parameters.minLineStartSegmentLength, line_ends, segment_sizes_end);
+#endif
+    {
+        ProfileScope scope(PROFILE_STAGE_DENOISE);
+        denoise_line_starts(parameters.minLineStartSegmentLength, line_starts, context.segmentSizesStart);
+        denoise_line_starts(parameters.minLineStartSegmentLength, line_ends, context.segmentSizesEnd);
+    }
 
+#ifdef ENABLE_VISUALIZATIONS
     auto line_starts_after_denoising = line_starts;
     auto line_ends_after_denoising = line_ends;
+#endif
 
     // merge_line_starts(line_starts, line_ends, line_starts);
-    int merged_from_starts_count = 0;
-    int merged_from_ends_count = 0;
-    merge_line_starts_adv(line_starts, line_ends, segment_sizes_start, segment_sizes_end, line_starts, merged_from_starts_count,
-                          merged_from_ends_count);
+    context.mergedFromStartsCount = 0;
+    context.mergedFromEndsCount = 0;
+    {
+        ProfileScope scope(PROFILE_STAGE_MERGE);
+        merge_line_starts_adv(line_starts, line_ends, context.segmentSizesStart, context.segmentSizesEnd, line_starts,
+                              context.mergedFromStartsCount, context.mergedFromEndsCount);
+    }
+#ifdef ENABLE_VISUALIZATIONS
     auto line_starts_merged = line_starts;
+#endif
 
-    bool someLineStartsKnown = fill_gaps_in_line_starts(line_starts);
+    bool someLineStartsKnown;
+    {
+        ProfileScope scope(PROFILE_STAGE_FILL_GAPS);
+        someLineStartsKnown = fill_gaps_in_line_starts(line_starts);
+    }
+#ifdef ENABLE_VISUALIZATIONS
     auto line_starts_gapfilled = line_starts;
+#endif
 
-    cv::Mat line_starts_mat(line_starts);
     if (someLineStartsKnown && parameters.lineStartSmoothingKernelSize > 0) {
+        ProfileScope scope(PROFILE_STAGE_SMOOTH);
         int kernelSize = parameters.lineStartSmoothingKernelSize | 0x1;
-        cv::blur(line_starts_mat, line_starts_mat, cv::Size(1, kernelSize));
+        smooth_line_starts(line_starts, kernelSize, context.smoothingBuffer);
+    }
+
+    // The final line starts are the prior of the next frame, unless the scene has changed.
+    if (temporal) {
+        context.hasPreviousLineStarts = someLineStartsKnown && !context.temporalPriorReset;
+        if (context.hasPreviousLineStarts) {
+            context.previousLineStarts = line_starts;
+        }
     }
 
 #ifdef ENABLE_VISUALIZATIONS
-    bool waitKey = false;
     cv::Vec3b color_for_line_starts(255, 255, 0);
+    int x_offset = frameSize.width - 2 * parameters.targetLineStart;
 #endif
 
-    int x_offset = input.cols - 2 * parameters.targetLineStart;
+#ifdef ENABLE_VISUALIZATIONS
+    // The line starts are drawn into BGR images. For planar YUV frames, the Y plane is shown.
+    cv::Mat debug_image;
+    if (is_planar_yuv(format)) {
+        cv::cvtColor(luma, debug_image, cv::COLOR_GRAY2BGR);
+    } else {
+        debug_image = input;
+    }
+#endif
 
 #ifdef ENABLE_VISUALIZATIONS
     // Raw line starts: green.
-    cv::Mat debug_image_line_starts_raw = input.clone();
+    cv::Mat debug_image_line_starts_raw = debug_image.clone();
     draw_line_starts(debug_image_line_starts_raw, line_starts_raw, color_for_line_starts, 0);
     draw_line_starts(debug_image_line_starts_raw, line_ends_raw, color_for_line_starts, x_offset);
     cv::namedWindow("1 - line_starts_raw");
     cv::imshow("1 - line_starts_raw", debug_image_line_starts_raw);
-    waitKey = true;
 #endif
 
 #ifdef ENABLE_VISUALIZATIONS
     // After denoising: red.
-    cv::Mat debug_image_line_starts_after_denoising = input.clone();
+    cv::Mat debug_image_line_starts_after_denoising = debug_image.clone();
     draw_line_starts(debug_image_line_starts_after_denoising, line_starts_after_denoising, color_for_line_starts, 0);
     draw_line_starts(debug_image_line_starts_after_denoising, line_ends_after_denoising, color_for_line_starts, x_offset);
     cv::namedWindow("2 - line_starts_after_denoising");
     cv::imshow("2 - line_starts_after_denoising", debug_image_line_starts_after_denoising);
-    waitKey = true;
 #endif
 
 #ifdef ENABLE_VISUALIZATIONS
     // After merging: yellow.
-    cv::Mat debug_image_line_starts_merged = input.clone();
+    cv::Mat debug_image_line_starts_merged = debug_image.clone();
     draw_line_starts(debug_image_line_starts_merged, line_starts_merged, color_for_line_starts, 0);
     cv::namedWindow("3 - line_starts_merged");
     cv::imshow("3 - line_starts_merged", debug_image_line_starts_merged);
-    waitKey = true;
 #endif
 
 #ifdef ENABLE_VISUALIZATIONS
     // After interpolating: cyan.
-    cv::Mat debug_image_line_starts_gapfilled = input.clone();
+    cv::Mat debug_image_line_starts_gapfilled = debug_image.clone();
     draw_line_starts(debug_image_line_starts_gapfilled, line_starts_gapfilled, cv::Vec3b(255, 0, 255), 0);
     draw_line_starts(debug_image_line_starts_gapfilled, line_starts_merged, color_for_line_starts, 0);
     cv::namedWindow("4 - line_starts_gapfilled");
     cv::imshow("4 - line_starts_gapfilled", debug_image_line_starts_gapfilled);
-    waitKey = true;
 #endif
 
 #ifdef ENABLE_VISUALIZATIONS
     // FINAL (after smoothing): blue.
-    cv::Mat debug_image_line_starts_smoothed = input.clone();
+    cv::Mat debug_image_line_starts_smoothed = debug_image.clone();
     draw_line_starts(debug_image_line_starts_smoothed, line_starts, cv::Vec3b(255, 0, 255), 0);
     cv::namedWindow("5 - line_starts_final (smoothed)");
     cv::imshow("5 - line_starts_final (smoothed)", debug_image_line_starts_smoothed);
-    waitKey = true;
 #endif
+}
 
-    // Use the line_start data obtained by the above code to shift the content of all rows of the frame
-    // such that each row begins at TARGET_LINE_START.
-    for (int y = 0; y < input.rows; ++y) {
-        cv::Mat input_row = input.row(y);
-        cv::Mat output_row = out.row(y);
-        int line_start = line_starts.at(y);
+void shift_frame(const cv::Mat &input, const vector<int> &line_starts, const ProcessingParameters &parameters, cv::Mat &out) {
+    ProfileScope scope(PROFILE_STAGE_SHIFT);
+    check_input(input, parameters);
 
-        if (line_start == MISSING) {
-            input_row.copyTo(output_row);
-        } else {
-            // Uncomment the following line to test the gap filling code below.
-            // If there are no white gaps at the sides of the output video, it's fine.
-            // output_row = cv::Scalar(255, 255, 255);
+    const cv::Size frameSize = get_frame_size(input, static_cast<FrameFormat>(parameters.frameFormat));
+    if (static_cast<int>(line_starts.size()) != frameSize.height) {
+        throw std::invalid_argument("number of line starts must match the height of the input frame");
+    }
+    out.create(input.size(), input.type());
 
-            int shift = parameters.targetLineStart - line_start;
-            if (shift > 0) {
-                // By shifting the line, we create a gap on one side of the line. This gap must be filled with zeroes.
-                memset(output_row.data, 0, shift * 3);
+    // Shift the content of all rows of the frame such that each row begins at targetLineStart.
+    const double num_bands = (frameSize.height + ROWS_PER_BAND - 1) / ROWS_PER_BAND;
+    cv::parallel_for_(cv::Range(0, frameSize.height), RowShifter(input, line_starts, parameters, out), num_bands);
+}
 
-                memcpy(output_row.data + shift * 3, input_row.data, (input_row.cols - shift) * 3);
-            } else if (shift < 0) {
-                int abs_shift = -shift;
+/**
+ * Smoothes the line_starts with a normalized box filter of the given (odd) size.
+ *
+ * The result is identical to cv::blur(cv::Mat(line_starts), ..., cv::Size(1, kernelSize)), i.e. the default border
+ * handling (BORDER_REFLECT_101) and cv::blur's integer rounding are used, but no memory is allocated.
+ *
+ * @param buffer    scratch buffer, must have the same size as line_starts
+ */
+void smooth_line_starts(vector<int> &line_starts, int kernelSize, vector<int> &buffer) {
+    assert(kernelSize % 2 == 1);
+    assert(buffer.size() == line_starts.size());
+
+    const int rows = static_cast<int>(line_starts.size());
+    const int radius = kernelSize / 2;
+    const double scale = 1.0 / kernelSize;
+
+    // Running sum over the window [y - radius, y + radius].
+    int sum = 0;
+    for (int k = -radius; k <= radius; ++k) {
+        sum += line_starts[cv::borderInterpolate(k, rows, cv::BORDER_REFLECT_101)];
+    }
+    for (int y = 0; y < rows; ++y) {
+        buffer[y] = cvRound(sum * scale);
+        sum += line_starts[cv::borderInterpolate(y + radius + 1, rows, cv::BORDER_REFLECT_101)];
+        sum -= line_starts[cv::borderInterpolate(y - radius, rows, cv::BORDER_REFLECT_101)];
+    }
 
-                // By shifting the line, we create a gap on one side of the line. This gap must be filled with zeroes.
-                memset(output_row.data + (output_row.cols - abs_shift) * 3, 0, abs_shift * 3);
+    line_starts.swap(buffer);
+}
 
-                memcpy(output_row.data, input_row.data + abs_shift * 3, (input_row.cols - abs_shift) * 3);
-            } else {
-                assert(shift == 0);
-                memcpy(output_row.data, input_row.data, input_row.cols * 3);
+/**
+ * Shifts the given rows of input by the amount needed to move their line_start to targetLineStart and saves them in out.
+ * The gaps created by shifting are filled with black. Rows with MISSING line_start are copied unchanged.
+ */
+void shift_rows(const cv::Mat &input, const vector<int> &line_starts, const ProcessingParameters &parameters, cv::Mat &out,
+                const cv::Range &rows) {
+    const FrameFormat format = static_cast<FrameFormat>(parameters.frameFormat);
+
+    if (!is_planar_yuv(format)) {
+        for (int y = rows.start; y < rows.end; ++y) {
+            shift_row(input.ptr<uint8_t>(y), out.ptr<uint8_t>(y), input.cols, 3, line_starts.at(y), parameters.targetLineStart, 0);
+        }
+        return;
+    }
+
+    // Planar YUV: the chroma planes are shifted by the same amount as the luma plane, scaled by the subsampling.
+    // With vertical subsampling, each chroma row belongs to several luma rows and is shifted like the first of them.
+    const cv::Mat planes_in[3] = {get_plane(input, format, 0), get_plane(input, format, 1), get_plane(input, format, 2)};
+    cv::Mat planes_out[3] = {get_plane(out, format, 0), get_plane(out, format, 1), get_plane(out, format, 2)};
+    const int sx = chroma_shift_x(format);
+    const int sy = chroma_shift_y(format);
+    for (int y = rows.start; y < rows.end; ++y) {
+        const int line_start = line_starts.at(y);
+        shift_row(planes_in[0].ptr<uint8_t>(y), planes_out[0].ptr<uint8_t>(y), planes_in[0].cols, 1, line_start, parameters.targetLineStart,
+                  YUV_BLACK_LUMA);
+
+        if (y % (1 << sy) == 0) {
+            const int chroma_line_start = line_start == MISSING ? MISSING : line_start / (1 << sx);
+            const int chroma_target_line_start = parameters.targetLineStart / (1 << sx);
+            for (int plane = 1; plane <= 2; ++plane) {
+                shift_row(planes_in[plane].ptr<uint8_t>(y >> sy), planes_out[plane].ptr<uint8_t>(y >> sy), planes_in[plane].cols, 1,
+                          chroma_line_start, chroma_target_line_start, YUV_BLACK_CHROMA);
             }
         }
     }
+}
 
-#ifdef ENABLE_VISUALIZATIONS
-    cv::namedWindow("6 - out");
-    cv::imshow("6 - out", out);
-    waitKey = true;
-#endif
+/**
+ * Shifts a single row of pixels so that its line_start moves to target_line_start.
+ *
+ * @param pixel_size    bytes per pixel (3 for BGR, 1 for a plane of a planar format)
+ * @param fill          value for the bytes of the gap that is created by shifting (black)
+ */
+void shift_row(const uint8_t *input_row, uint8_t *output_row, int cols, int pixel_size, int line_start, int target_line_start,
+               uint8_t fill) {
+    if (line_start == MISSING) {
+        memcpy(output_row, input_row, cols * pixel_size);
+        return;
+    }
 
-#ifdef ENABLE_VISUALIZATIONS
-    if (waitKey) {
-        cv::waitKey();
+    // Uncomment the following line to test the gap filling code below.
+    // If there are no white gaps at the sides of the output video, it's fine.
+    // memset(output_row, 255, cols * pixel_size);
+
+    int shift = target_line_start - line_start;
+    if (shift > 0) {
+        // By shifting the line, we create a gap on one side of the line. This gap must be filled with black.
+        memset(output_row, fill, shift * pixel_size);
+
+        memcpy(output_row + shift * pixel_size, input_row, (cols - shift) * pixel_size);
+    } else if (shift < 0) {
+        int abs_shift = -shift;
+
+        // By shifting the line, we create a gap on one side of the line. This gap must be filled with black.
+        memset(output_row + (cols - abs_shift) * pixel_size, fill, abs_shift * pixel_size);
+
+        memcpy(output_row, input_row + abs_shift * pixel_size, (cols - abs_shift) * pixel_size);
+    } else {
+        assert(shift == 0);
+        memcpy(output_row, input_row, cols * pixel_size);
     }
-#endif
 }
 
 void draw_line_starts(cv::Mat &img, const std::vector<int> line_starts, const cv::Vec3b &color, int x_offset) {
@@ -193,7 +405,20 @@ void draw_line_starts(cv::Mat &img, const std::vector<int> line_starts, const cv
 }
 
 /**
- * Scans all rows in gray to find the positions where the black border meets the actual video content.
+ * Returns the threshold that the pixels of the scanned strips are compared against.
+ *
+ * pureBlackThreshold refers to full-range grayscale values (as computed from the BGR frames). Planar YUV frames are
+ * scanned on their limited-range Y plane, where black is 16 and white is 235, so the threshold is mapped to that range.
+ */
+uint8_t get_scan_threshold(const ProcessingParameters &parameters) {
+    if (!is_planar_yuv(static_cast<FrameFormat>(parameters.frameFormat))) {
+        return static_cast<uint8_t>(parameters.pureBlackThreshold);
+    }
+    return static_cast<uint8_t>(YUV_BLACK_LUMA + cvRound(parameters.pureBlackThreshold * (219.0 / 255.0)));
+}
+
+/**
+ * Scans all rows in strip to find the positions where the black border meets the actual video content.
  *
  * These positions are referred to as (raw) line_starts. They are used to cleanup horizontal shaking by
  * un-shifting/re-aligning all rows of the frame such that all lines start at the same position.
@@ -202,69 +427,62 @@ void draw_line_starts(cv::Mat &img, const std::vector<int> line_starts, const cv
  * e.g. all lines would start at X = 8 and end at X = W - 8 (where 8 is the size of the black border to the left
  * and right).
  *
- * @param gray          must be a ROI that contains either the left-hand columns or right-hand columns of a video frame
+ * @param strip         must be a ROI that contains either the left-hand columns or right-hand columns of a video frame, either
+ *                      as grayscale image or in BGR (in that case the grayscale values are computed on the fly)
  * @param parameters    see ProcessingParameters.h
  * @param direction     indicates whether sobelX is based on the left-hand part of the video (use the constant DIRECTION_LEFT_TO_RIGHT) or
  * 	                    the right-hand part of the video (use constant DIRECTION_RIGHT_TO_LEFT).
  * @param line_starts   the determined line starts are saved in this list, i.e. line_starts.size() == sobelX.rows. The line
  * 	                    start data may be incomplete, i.e. for some rows it may be impossible to determine the start
  *                      position. The respective missing items in line_starts get assigned the special constant MISSING.
+ *                      Must already have been resized to strip.rows.
+ * @param rows          only these rows are scanned, so that row bands can be scanned in parallel
+ * @param prior         if not nullptr, the final line starts of the previous frame. Each row is searched within
+ *                      parameters.temporalSearchWindow columns around it first (see find_raw_line_start_in_window).
+ * @param fallbacks     incremented for each row that has to be scanned fully although it has a prior (only used with a prior)
  */
-void get_raw_line_starts(const cv::Mat &gray, const ProcessingParameters &parameters, vector<int> &line_starts, int direction) {
+void get_raw_line_starts(const cv::Mat &strip, const ProcessingParameters &parameters, vector<int> &line_starts, int direction,
+                         const cv::Range &rows, const vector<int> *prior, vector<uint8_t> *fallbacks) {
     assert(direction == DIRECTION_LEFT_TO_RIGHT || direction == DIRECTION_RIGHT_TO_LEFT);
-    line_starts.resize(gray.rows, MISSING);
+    assert(strip.type() == CV_8UC1 || strip.type() == CV_8UC3);
+    assert(line_starts.size() == strip.rows);
 
-    int x_start, x_step, x_stop;
-    if (direction == DIRECTION_LEFT_TO_RIGHT) {
-        x_step = 1;
-        x_start = 0;
-        x_stop = gray.cols;
-    } else if (direction == DIRECTION_RIGHT_TO_LEFT) {
-        x_step = -1;
-        x_start = gray.cols - 1;
-        x_stop = -1;
-    } else {
-        assert(false);
-    }
+    const uint8_t threshold = get_scan_threshold(parameters);
+    const int reference_point = strip.cols - 2 * parameters.pureBlackWidth;
+    const bool is_gray = strip.type() == CV_8UC1;
+    auto find_first = is_gray ? find_first_above_threshold : find_first_luma_above_threshold;
+    auto find_last = is_gray ? find_last_above_threshold : find_last_luma_above_threshold;
 
-    for (int y = 0; y < gray.rows; ++y) {
+    for (int y = rows.start; y < rows.end; ++y) {
+        const uint8_t *row = strip.ptr<uint8_t>(y);
         line_starts[y] = MISSING;
-        for (int x = x_start; x != x_stop; x += x_step) {
-            // If there is no pure black at the edge, skip this row. The line start/end
-            // cannot be determined.
-            uint8_t pixel_value = gray.at<uint8_t>(y, x);
-            if (x == x_start && pixel_value > parameters.pureBlackThreshold) {
-                break;
-            }
 
-            if (pixel_value > parameters.pureBlackThreshold) {
-#if 0
-				input.at<cv::Vec3b>(y, x) = cv::Vec3b(255, 255, 255);
-#endif
+        // With a prior, only the window around the expected position is searched. If the edge is not found there,
+        // the row is scanned fully.
+        if (prior != nullptr && (*prior)[y] != MISSING) {
+            const int expected = direction == DIRECTION_LEFT_TO_RIGHT ? (*prior)[y] : (*prior)[y] + reference_point;
+            int x = find_raw_line_start_in_window(row, strip.cols, is_gray, threshold, direction, expected, parameters.temporalSearchWindow);
+            if (x != -1) {
+                line_starts[y] = direction == DIRECTION_LEFT_TO_RIGHT ? x : x - reference_point;
+                continue;
+            }
+            ++(*fallbacks)[y];
+        }
 
-#if 1
-                if (direction == DIRECTION_LEFT_TO_RIGHT) {
-                    line_starts[y] = x;
-                } else if (direction == DIRECTION_RIGHT_TO_LEFT) {
-                    int reference_point = (gray.cols - 2 * parameters.pureBlackWidth);
-                    line_starts[y] = x - reference_point;
-                }
-#else
-                // Old code that only worked because my colRange value (15) happened to be close to 2 * TARGET_LINE_START.
-                // And TARGET_LINE_START equaled 8 for my videos. So 2 * TARGET_LINE_START was 16, which is almost the same
-                // as colRange (15).
+        // The line start/end is the first pixel above the threshold when scanning from the edge towards the center.
+        // If the pixel at the edge itself is above the threshold, there is no pure black at the edge and the line
+        // start/end cannot be determined.
+        if (direction == DIRECTION_LEFT_TO_RIGHT) {
+            int x = find_first(row, strip.cols, threshold);
+            if (x > 0) {
                 line_starts[y] = x;
-#endif
-
-                break;
+            }
+        } else if (direction == DIRECTION_RIGHT_TO_LEFT) {
+            int x = find_last(row, strip.cols, threshold);
+            if (x != -1 && x != strip.cols - 1) {
+                line_starts[y] = x - reference_point;
             }
         }
-
-#if 0
-		if (y == 0) {
-			cout << input_row << endl;
-		}
-#endif
     }
 
 #if 0
@@ -272,12 +490,92 @@ void get_raw_line_starts(const cv::Mat &gray, const ProcessingParameters &parame
 #endif
 }
 
+/**
+ * Searches a row of a border strip for the line start (or line end) only within expected +/- window columns.
+ *
+ * The edge is accepted if the pixel at the border of the frame and the pixel just outside the window (on the side of
+ * the black border) are not above the threshold, and a pixel above the threshold is found within the window. The
+ * pixels between the border of the frame and the window are not checked, i.e. in rare cases (bright noise in the
+ * black border) the result differs from the full scan of get_raw_line_starts.
+ *
+ * @returns the column of the edge within the strip, or -1 if it was not found in the window
+ */
+int find_raw_line_start_in_window(const uint8_t *row, int cols, bool is_gray, uint8_t threshold, int direction, int expected, int window) {
+    auto luma = [&](int x) { return is_gray ? row[x] : bgr_to_luma(row + 3 * x); };
+    const int pixel_size = is_gray ? 1 : 3;
+
+    if (direction == DIRECTION_LEFT_TO_RIGHT) {
+        // The window [begin, end) starts right of column 0, which must be black.
+        const int begin = std::max(1, expected - window);
+        const int end = std::min(cols, expected + window + 1);
+        if (begin >= end || luma(0) > threshold || luma(begin - 1) > threshold) {
+            return -1;
+        }
+        int x = is_gray ? find_first_above_threshold(row + begin, end - begin, threshold)
+                        : find_first_luma_above_threshold(row + pixel_size * begin, end - begin, threshold);
+        return x == -1 ? -1 : begin + x;
+    }
+
+    // The window [begin, end) ends left of column cols - 1, which must be black.
+    const int begin = std::max(0, expected - window);
+    const int end = std::min(cols - 1, expected + window + 1);
+    if (begin >= end || luma(cols - 1) > threshold || luma(end) > threshold) {
+        return -1;
+    }
+    int x = is_gray ? find_last_above_threshold(row + begin, end - begin, threshold)
+                    : find_last_luma_above_threshold(row + pixel_size * begin, end - begin, threshold);
+    return x == -1 ? -1 : begin + x;
+}
+
+/**
+ * Returns true if the borders are byte-identical to the borders of the previous frame that have been stored in the
+ * context. The comparison stops at the first difference, so it is cheap for frames that differ.
+ */
+bool borders_match_previous_frame(const cv::Mat &leftBorder, const cv::Mat &rightBorder, DeshakeContext &context) {
+    if (!context.hasPreviousBorders || context.previousLeftBorder.size() != leftBorder.size() ||
+        context.previousLeftBorder.type() != leftBorder.type()) {
+        return false;
+    }
+
+    const size_t row_bytes = leftBorder.cols * leftBorder.elemSize();
+    for (int y = 0; y < leftBorder.rows; ++y) {
+        if (memcmp(leftBorder.ptr(y), context.previousLeftBorder.ptr(y), row_bytes) != 0 ||
+            memcmp(rightBorder.ptr(y), context.previousRightBorder.ptr(y), row_bytes) != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Counts the rows of the last frame that were searched with the temporal prior and how many of them had to be scanned
+ * fully. If the edge was not found in the window for more than half of the searches, the scene has most likely
+ * changed (e.g. a cut or a different recording), so the prior is dropped and the next frame is scanned fully.
+ */
+void update_temporal_statistics(DeshakeContext &context) {
+    context.temporalWindowRows = 0;
+    context.temporalFallbackRows = 0;
+    context.temporalPriorReset = false;
+    if (!context.hasPreviousLineStarts) {
+        return;
+    }
+
+    for (size_t y = 0; y < context.previousLineStarts.size(); ++y) {
+        if (context.previousLineStarts[y] != MISSING) {
+            // Both the left- and the right-hand side of each row are searched.
+            context.temporalWindowRows += 2;
+            context.temporalFallbackRows += context.temporalFallbacks[y];
+        }
+    }
+    context.temporalPriorReset = 2 * context.temporalFallbackRows > context.temporalWindowRows;
+}
+
 /**
  * Cleans up / denoises the line_starts. Compact segments of subsequent (i.e. neighboring) line_starts
  * are only kept if they are at least minSegmentLength rows long.
  */
 void denoise_line_starts(const int minSegmentLength, vector<int> &line_starts, vector<int> &segment_sizes) {
-    segment_sizes.resize(line_starts.size(), 0);
+    segment_sizes.assign(line_starts.size(), 0);
     const int MIN_SEGMENT_LENGTH = minSegmentLength;
 
     int current_segment_begin = -1;
@@ -0,0 +1,132 @@
+/**
+ * Tests that correct_frame does not allocate memory once the DeshakeContext has been prepared by the first frame
+ * (correct-frame-alloc-test, run by ctest).
+ *
+ * The global operator new is replaced to count the allocations. cv::Mat buffers are allocated with cv::fastMalloc
+ * instead, so the data pointers of the output frame and the buffers of the context must not change either.
+ */
+#include "DeshakeContext.h"
+#include "correct_frame.h"
+#include <atomic>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <random>
+#include <string>
+
+namespace {
+
+std::atomic<bool> counting_allocations(false);
+std::atomic<long> allocations(0);
+
+// Number of frames that are corrected (and checked) after the first frame.
+const int STEADY_STATE_FRAMES = 20;
+
+int failures = 0;
+
+/**
+ * Creates a frame with random content between black borders of pureBlackWidth columns. Each row is shifted by a random
+ * jitter of up to 3 pixels, so that frames created with different seeds have different borders.
+ */
+cv::Mat create_frame(const cv::Size &frameSize, FrameFormat format, const ProcessingParameters &parameters, unsigned seed) {
+    std::mt19937 rng(seed);
+    std::uniform_int_distribution<int> jitter(-3, 3);
+    std::uniform_int_distribution<int> content(60, 230);
+
+    cv::Mat frame;
+    create_frame_buffer(frame, frameSize, format);
+    frame.setTo(cv::Scalar::all(is_planar_yuv(format) ? 128 : 0));
+    cv::Mat luma = is_planar_yuv(format) ? get_plane(frame, format, 0) : frame;
+    const int pixel_size = static_cast<int>(luma.elemSize());
+    const uint8_t black = is_planar_yuv(format) ? 16 : 0;
+    for (int y = 0; y < frameSize.height; ++y) {
+        const int shift = jitter(rng);
+        uint8_t *row = luma.ptr<uint8_t>(y);
+        for (int x = 0; x < frameSize.width * pixel_size; ++x) {
+            const int col = x / pixel_size;
+            const bool border = col < parameters.pureBlackWidth + shift || col >= frameSize.width - parameters.pureBlackWidth + shift;
+            row[x] = border ? black : static_cast<uint8_t>(content(rng));
+        }
+    }
+    return frame;
+}
+
+void check_steady_state(const std::string &name, FrameFormat format, const ProcessingParameters &parameters) {
+    const cv::Size frameSize(720, 576);
+    const cv::Mat frames[2] = {create_frame(frameSize, format, parameters, 1), create_frame(frameSize, format, parameters, 2)};
+
+    DeshakeContext context;
+    cv::Mat out;
+    correct_frame(frames[0], parameters, context, out);
+    const uint8_t *out_data = out.data;
+    const uint8_t *left_border_data = context.previousLeftBorder.data;
+    const uint8_t *right_border_data = context.previousRightBorder.data;
+
+    // Each frame is repeated up to three times, so that the duplicate-frame path is covered as well.
+    allocations = 0;
+    counting_allocations = true;
+    for (int i = 1; i <= STEADY_STATE_FRAMES; ++i) {
+        correct_frame(frames[(i / 3) % 2], parameters, context, out);
+    }
+    counting_allocations = false;
+
+    const bool buffers_kept = out.data == out_data && context.previousLeftBorder.data == left_border_data &&
+                              context.previousRightBorder.data == right_border_data;
+    if (allocations != 0 || !buffers_kept) {
+        std::cerr << "FAILED: " << name << ": " << allocations << " allocations with operator new"
+                  << (buffers_kept ? "" : ", cv::Mat buffers have been reallocated") << std::endl;
+        ++failures;
+    } else {
+        std::cout << name << ": no allocations in " << STEADY_STATE_FRAMES << " frames" << std::endl;
+    }
+}
+
+} // namespace
+
+void *operator new(std::size_t size) {
+    if (counting_allocations) {
+        ++allocations;
+    }
+    if (void *p = std::malloc(size == 0 ? 1 : size)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void *operator new[](std::size_t size) { return operator new(size); }
+
+void operator delete(void *p) noexcept { std::free(p); }
+
+void operator delete[](void *p) noexcept { std::free(p); }
+
+void operator delete(void *p, std::size_t) noexcept { std::free(p); }
+
+void operator delete[](void *p, std::size_t) noexcept { std::free(p); }
+
+int main() {
+    // OpenCV's thread pool allocates a job for each cv::parallel_for_ call. Those allocations are not caused by
+    // correct_frame, so the row bands are processed on this thread.
+    cv::setNumThreads(0);
+
+    // SCAN_METHOD_GRAY is not checked for BGR frames: it converts the borders with cv::cvtColor, whose internal
+    // allocations depend on the OpenCV build.
+    for (FrameFormat format : {FRAME_FORMAT_BGR24, FRAME_FORMAT_YUV420P}) {
+        const std::string format_name = frame_format_name(format);
+        ProcessingParameters parameters;
+        parameters.colRange = 2 * parameters.pureBlackWidth;
+        parameters.targetLineStart = parameters.pureBlackWidth;
+        parameters.frameFormat = format;
+        parameters.detectDuplicateFrames = true;
+        check_steady_state(format_name, format, parameters);
+
+        ProcessingParameters temporal = parameters;
+        temporal.temporalSearchWindow = 4;
+        check_steady_state(format_name + " with temporal window", format, temporal);
+    }
+
+    if (failures > 0) {
+        std::cerr << failures << " checks failed" << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,416 @@
+/**
+ * Microbenchmarks of correct_frame and its stages (vhs-deshaker-bench, only built if Google Benchmark is found).
+ *
+ * The frames are synthetic: random content between black borders of ProcessingParameters::DEFAULT_PURE_BLACK_WIDTH
+ * columns, with each row shifted by a known jitter (a slow wave plus +/-1 pixel of noise) and a few bands of dark rows
+ * without line starts, so that the gap filling has work to do. No video files are needed.
+ *
+ * The stage benchmarks call the internal functions of correct_frame.cpp on one thread. BM_CorrectFrame measures the
+ * full call, which processes the row bands on OpenCV's thread pool like vhs-deshaker does.
+ */
+#include "DeshakeContext.h"
+#include "correct_frame.h"
+#include "correct_frame_internal.h"
+#include "scan_kernels.h"
+#include <benchmark/benchmark.h>
+#include <cassert>
+#include <cmath>
+#include <cstdlib>
+#include <opencv2/imgproc.hpp>
+#include <vector>
+
+using std::vector;
+
+namespace {
+
+// Maximum jitter of the synthetic frames in pixels. Must be smaller than the pure black width, so that every row still
+// starts and ends with black.
+const int JITTER_AMPLITUDE = 4;
+
+// Every JITTER_DARK_BAND_PERIOD rows, JITTER_DARK_BAND_ROWS rows have dark content (no line starts).
+const int JITTER_DARK_BAND_PERIOD = 96;
+const int JITTER_DARK_BAND_ROWS = 6;
+
+const int COL_RANGES[] = {16, 32, 64};
+const int SMOOTHING_KERNEL_SIZES[] = {11, 51, 201};
+
+// PAL, NTSC, HDV / 1080i anamorphic and 4K UHD.
+const cv::Size GEOMETRIES[] = {cv::Size(720, 576), cv::Size(720, 480), cv::Size(1440, 1080), cv::Size(3840, 2160)};
+
+// Numbers of OpenCV threads for BM_CorrectFrameThreads (1 = the row bands are processed serially).
+const int THREAD_COUNTS[] = {1, 2, 4, 8};
+
+/**
+ * A synthetic frame and the line start of each row, i.e. the column where its content starts.
+ */
+struct JitteredFrame {
+    cv::Mat frame;
+    vector<int> lineStarts;
+};
+
+/**
+ * Creates a synthetic frame with known jitter (see the comment at the top of this file). The same frame size and
+ * format always give the same frame.
+ */
+JitteredFrame create_jittered_frame(const cv::Size &frameSize, FrameFormat format) {
+    const int pure_black_width = ProcessingParameters::DEFAULT_PURE_BLACK_WIDTH;
+    cv::RNG rng(0x5eed);
+
+    JitteredFrame result;
+    create_frame_buffer(result.frame, frameSize, format);
+    result.frame.setTo(cv::Scalar::all(is_planar_yuv(format) ? 128 : 0));
+    cv::Mat luma = is_planar_yuv(format) ? get_plane(result.frame, format, 0) : result.frame;
+    const int pixel_size = static_cast<int>(luma.elemSize());
+    const uint8_t black = is_planar_yuv(format) ? 16 : 0;
+
+    result.lineStarts.resize(frameSize.height);
+    for (int y = 0; y < frameSize.height; ++y) {
+        const double wave = std::sin(2 * CV_PI * y / 240.0) * (JITTER_AMPLITUDE - 1);
+        const int jitter = cvRound(wave) + rng.uniform(-1, 2);
+        const int begin = pure_black_width + jitter;
+        const int end = frameSize.width - pure_black_width + jitter;
+        result.lineStarts[y] = begin;
+
+        // Dark rows are below any pure black threshold, but still above black.
+        const bool dark = y % JITTER_DARK_BAND_PERIOD < JITTER_DARK_BAND_ROWS;
+        uint8_t *row = luma.ptr<uint8_t>(y);
+        for (int x = 0; x < frameSize.width * pixel_size; ++x) {
+            const int col = x / pixel_size;
+            row[x] = col < begin || col >= end ? black : static_cast<uint8_t>(dark ? black + 1 : rng.uniform(60, 230));
+        }
+    }
+    return result;
+}
+
+ProcessingParameters get_parameters(FrameFormat format, int col_range, int kernel_size = ProcessingParameters::DEFAULT_LINE_START_SMOOTHING_KERNEL_SIZE) {
+    ProcessingParameters parameters;
+    parameters.colRange = col_range;
+    parameters.targetLineStart = parameters.pureBlackWidth;
+    parameters.lineStartSmoothingKernelSize = kernel_size;
+    parameters.frameFormat = format;
+    // The same frame is corrected in every iteration, which would otherwise be detected as a duplicate frame.
+    parameters.detectDuplicateFrames = false;
+    return parameters;
+}
+
+cv::Size get_benchmark_frame_size(const benchmark::State &state) { return cv::Size(static_cast<int>(state.range(0)), static_cast<int>(state.range(1))); }
+
+/**
+ * Runs the detection of correct_frame on a synthetic frame, up to (not including) the denoising.
+ */
+void scan_raw_line_starts(const JitteredFrame &jittered, const ProcessingParameters &parameters, DeshakeContext &context) {
+    context.prepare(jittered.frame.size(), parameters);
+    const cv::Mat leftBorder = jittered.frame.colRange(0, parameters.colRange);
+    const cv::Mat rightBorder = jittered.frame.colRange(jittered.frame.cols - parameters.colRange, jittered.frame.cols);
+    const cv::Range rows(0, jittered.frame.rows);
+    get_raw_line_starts(leftBorder, parameters, context.lineStarts, DIRECTION_LEFT_TO_RIGHT, rows);
+    get_raw_line_starts(rightBorder, parameters, context.lineEnds, DIRECTION_RIGHT_TO_LEFT, rows);
+}
+
+void set_rows_processed(benchmark::State &state, int rows) { state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) * rows); }
+
+// Arguments: width, height, colRange.
+void geometry_col_range_args(benchmark::internal::Benchmark *benchmark) {
+    benchmark->ArgNames({"width", "height", "colrange"});
+    for (const cv::Size &size : GEOMETRIES) {
+        for (int col_range : COL_RANGES) {
+            benchmark->Args({size.width, size.height, col_range});
+        }
+    }
+}
+
+// Arguments: width, height (the stages after the scan do not depend on colRange).
+void geometry_args(benchmark::internal::Benchmark *benchmark) {
+    benchmark->ArgNames({"width", "height"});
+    for (const cv::Size &size : GEOMETRIES) {
+        benchmark->Args({size.width, size.height});
+    }
+}
+
+// Arguments: width, height, smoothing kernel size.
+void geometry_kernel_args(benchmark::internal::Benchmark *benchmark) {
+    benchmark->ArgNames({"width", "height", "kernel"});
+    for (const cv::Size &size : GEOMETRIES) {
+        for (int kernel_size : SMOOTHING_KERNEL_SIZES) {
+            benchmark->Args({size.width, size.height, kernel_size});
+        }
+    }
+}
+
+// Arguments: width, height, number of threads.
+void geometry_threads_args(benchmark::internal::Benchmark *benchmark) {
+    benchmark->ArgNames({"width", "height", "threads"});
+    for (const cv::Size &size : GEOMETRIES) {
+        for (int threads : THREAD_COUNTS) {
+            benchmark->Args({size.width, size.height, threads});
+        }
+    }
+}
+
+// Arguments: width, height, colRange, smoothing kernel size.
+void geometry_col_range_kernel_args(benchmark::internal::Benchmark *benchmark) {
+    benchmark->ArgNames({"width", "height", "colrange", "kernel"});
+    for (const cv::Size &size : GEOMETRIES) {
+        for (int col_range : COL_RANGES) {
+            for (int kernel_size : SMOOTHING_KERNEL_SIZES) {
+                benchmark->Args({size.width, size.height, col_range, kernel_size});
+            }
+        }
+    }
+}
+
+void BM_CvtColor(benchmark::State &state) {
+    const JitteredFrame jittered = create_jittered_frame(get_benchmark_frame_size(state), FRAME_FORMAT_BGR24);
+    const int col_range = static_cast<int>(state.range(2));
+    const cv::Mat leftBorder = jittered.frame.colRange(0, col_range);
+    const cv::Mat rightBorder = jittered.frame.colRange(jittered.frame.cols - col_range, jittered.frame.cols);
+    cv::Mat gray1, gray2;
+    for (auto _ : state) {
+        cv::cvtColor(leftBorder, gray1, cv::COLOR_BGR2GRAY);
+        cv::cvtColor(rightBorder, gray2, cv::COLOR_BGR2GRAY);
+    }
+    set_rows_processed(state, jittered.frame.rows);
+}
+
+// Scans both borders of a BGR frame, computing the grayscale values on the fly (SCAN_METHOD_FUSED).
+void BM_ScanFused(benchmark::State &state) {
+    const JitteredFrame jittered = create_jittered_frame(get_benchmark_frame_size(state), FRAME_FORMAT_BGR24);
+    const ProcessingParameters parameters = get_parameters(FRAME_FORMAT_BGR24, static_cast<int>(state.range(2)));
+    DeshakeContext context;
+    for (auto _ : state) {
+        scan_raw_line_starts(jittered, parameters, context);
+        benchmark::DoNotOptimize(context.lineStarts.data());
+    }
+    set_rows_processed(state, jittered.frame.rows);
+}
+
+// Scans both borders of a planar YUV frame, i.e. the Y plane (the same as SCAN_METHOD_GRAY after the cvtColor stage).
+void BM_ScanGray(benchmark::State &state) {
+    const JitteredFrame jittered = create_jittered_frame(get_benchmark_frame_size(state), FRAME_FORMAT_YUV420P);
+    const ProcessingParameters parameters = get_parameters(FRAME_FORMAT_YUV420P, static_cast<int>(state.range(2)));
+    const cv::Mat luma = get_plane(jittered.frame, FRAME_FORMAT_YUV420P, 0);
+    DeshakeContext context;
+    context.prepare(luma.size(), parameters);
+    const cv::Range rows(0, luma.rows);
+    for (auto _ : state) {
+        get_raw_line_starts(luma.colRange(0, parameters.colRange), parameters, context.lineStarts, DIRECTION_LEFT_TO_RIGHT, rows);
+        get_raw_line_starts(luma.colRange(luma.cols - parameters.colRange, luma.cols), parameters, context.lineEnds,
+                            DIRECTION_RIGHT_TO_LEFT, rows);
+        benchmark::DoNotOptimize(context.lineStarts.data());
+    }
+    set_rows_processed(state, luma.rows);
+}
+
+/**
+ * Same as get_raw_line_starts, but the rows are processed in tiles of TRANSPOSED_TILE_ROWS rows. Each tile is
+ * transposed into column-major order (with the grayscale value of each pixel) and then scanned column by column,
+ * checking all rows of the tile with a single vector comparison per column.
+ *
+ * Unlike get_raw_line_starts, the cost per row does not depend on where the line start is found: every pixel of the
+ * strip is converted (scalar) before the tile is scanned. Since the line starts are usually close to the edge of the
+ * frame, this is 2-8x slower than get_raw_line_starts (more for larger colRange values), so it is not a scan method of
+ * correct_frame. It is only kept here to measure the alternative (BM_ScanTransposed).
+ */
+void get_raw_line_starts_transposed(const cv::Mat &strip, const ProcessingParameters &parameters, vector<int> &line_starts, int direction,
+                                    const cv::Range &rows) {
+    assert(direction == DIRECTION_LEFT_TO_RIGHT || direction == DIRECTION_RIGHT_TO_LEFT);
+    assert(strip.type() == CV_8UC1 || strip.type() == CV_8UC3);
+    assert(line_starts.size() == strip.rows);
+
+    const uint8_t threshold = get_scan_threshold(parameters);
+    const int reference_point = strip.cols - 2 * parameters.pureBlackWidth;
+    const bool is_gray = strip.type() == CV_8UC1;
+
+    // The tile columns are ordered in scan direction, i.e. tile column 0 is the column at the edge of the frame.
+    // The tile is kept on the stack unless colRange is larger than 256.
+    cv::AutoBuffer<uint8_t, 256 * TRANSPOSED_TILE_ROWS> tile(strip.cols * TRANSPOSED_TILE_ROWS);
+    int first[TRANSPOSED_TILE_ROWS];
+
+    for (int tile_begin = rows.start; tile_begin < rows.end; tile_begin += TRANSPOSED_TILE_ROWS) {
+        const int tile_rows = std::min(TRANSPOSED_TILE_ROWS, rows.end - tile_begin);
+
+        for (int r = 0; r < tile_rows; ++r) {
+            const uint8_t *row = strip.ptr<uint8_t>(tile_begin + r);
+            for (int c = 0; c < strip.cols; ++c) {
+                int x = direction == DIRECTION_LEFT_TO_RIGHT ? c : strip.cols - 1 - c;
+                tile[c * TRANSPOSED_TILE_ROWS + r] = is_gray ? row[x] : bgr_to_luma(row + 3 * x);
+            }
+        }
+
+        find_first_above_threshold_transposed(tile.data(), strip.cols, tile_rows, threshold, first);
+
+        // As in get_raw_line_starts, rows without pure black at the edge (c == 0) have no line start.
+        for (int r = 0; r < tile_rows; ++r) {
+            int c = first[r];
+            int y = tile_begin + r;
+            if (c <= 0) {
+                line_starts[y] = MISSING;
+            } else if (direction == DIRECTION_LEFT_TO_RIGHT) {
+                line_starts[y] = c;
+            } else {
+                line_starts[y] = (strip.cols - 1 - c) - reference_point;
+            }
+        }
+    }
+}
+
+// Scans both borders of a BGR frame with get_raw_line_starts_transposed.
+void BM_ScanTransposed(benchmark::State &state) {
+    const JitteredFrame jittered = create_jittered_frame(get_benchmark_frame_size(state), FRAME_FORMAT_BGR24);
+    const ProcessingParameters parameters = get_parameters(FRAME_FORMAT_BGR24, static_cast<int>(state.range(2)));
+    DeshakeContext context;
+    context.prepare(jittered.frame.size(), parameters);
+    const cv::Mat leftBorder = jittered.frame.colRange(0, parameters.colRange);
+    const cv::Mat rightBorder = jittered.frame.colRange(jittered.frame.cols - parameters.colRange, jittered.frame.cols);
+    const cv::Range rows(0, jittered.frame.rows);
+    for (auto _ : state) {
+        get_raw_line_starts_transposed(leftBorder, parameters, context.lineStarts, DIRECTION_LEFT_TO_RIGHT, rows);
+        get_raw_line_starts_transposed(rightBorder, parameters, context.lineEnds, DIRECTION_RIGHT_TO_LEFT, rows);
+        benchmark::DoNotOptimize(context.lineStarts.data());
+    }
+    set_rows_processed(state, jittered.frame.rows);
+}
+
+// The stages after the scan work in place, so each iteration starts from a copy of the raw line starts. The copies are
+// included in the measured time (they are much cheaper than the stages).
+void BM_Denoise(benchmark::State &state) {
+    const JitteredFrame jittered = create_jittered_frame(get_benchmark_frame_size(state), FRAME_FORMAT_BGR24);
+    const ProcessingParameters parameters = get_parameters(FRAME_FORMAT_BGR24, COL_RANGES[0]);
+    DeshakeContext context;
+    scan_raw_line_starts(jittered, parameters, context);
+    const vector<int> raw_line_starts = context.lineStarts;
+    const vector<int> raw_line_ends = context.lineEnds;
+    for (auto _ : state) {
+        context.lineStarts = raw_line_starts;
+        context.lineEnds = raw_line_ends;
+        denoise_line_starts(parameters.minLineStartSegmentLength, context.lineStarts, context.segmentSizesStart);
+        denoise_line_starts(parameters.minLineStartSegmentLength, context.lineEnds, context.segmentSizesEnd);
+        benchmark::DoNotOptimize(context.lineStarts.data());
+    }
+    set_rows_processed(state, jittered.frame.rows);
+}
+
+void BM_Merge(benchmark::State &state) {
+    const JitteredFrame jittered = create_jittered_frame(get_benchmark_frame_size(state), FRAME_FORMAT_BGR24);
+    const ProcessingParameters parameters = get_parameters(FRAME_FORMAT_BGR24, COL_RANGES[0]);
+    DeshakeContext context;
+    scan_raw_line_starts(jittered, parameters, context);
+    denoise_line_starts(parameters.minLineStartSegmentLength, context.lineStarts, context.segmentSizesStart);
+    denoise_line_starts(parameters.minLineStartSegmentLength, context.lineEnds, context.segmentSizesEnd);
+    const vector<int> denoised_line_starts = context.lineStarts;
+    for (auto _ : state) {
+        context.lineStarts = denoised_line_starts;
+        merge_line_starts_adv(context.lineStarts, context.lineEnds, context.segmentSizesStart, context.segmentSizesEnd,
+                              context.lineStarts, context.mergedFromStartsCount, context.mergedFromEndsCount);
+        benchmark::DoNotOptimize(context.lineStarts.data());
+    }
+    set_rows_processed(state, jittered.frame.rows);
+}
+
+void BM_FillGaps(benchmark::State &state) {
+    const JitteredFrame jittered = create_jittered_frame(get_benchmark_frame_size(state), FRAME_FORMAT_BGR24);
+    const ProcessingParameters parameters = get_parameters(FRAME_FORMAT_BGR24, COL_RANGES[0]);
+    DeshakeContext context;
+    scan_raw_line_starts(jittered, parameters, context);
+    denoise_line_starts(parameters.minLineStartSegmentLength, context.lineStarts, context.segmentSizesStart);
+    denoise_line_starts(parameters.minLineStartSegmentLength, context.lineEnds, context.segmentSizesEnd);
+    merge_line_starts_adv(context.lineStarts, context.lineEnds, context.segmentSizesStart, context.segmentSizesEnd, context.lineStarts,
+                          context.mergedFromStartsCount, context.mergedFromEndsCount);
+    const vector<int> merged_line_starts = context.lineStarts;
+    for (auto _ : state) {
+        context.lineStarts = merged_line_starts;
+        benchmark::DoNotOptimize(fill_gaps_in_line_starts(context.lineStarts));
+    }
+    set_rows_processed(state, jittered.frame.rows);
+}
+
+void BM_Smooth(benchmark::State &state) {
+    const JitteredFrame jittered = create_jittered_frame(get_benchmark_frame_size(state), FRAME_FORMAT_BGR24);
+    const int kernel_size = static_cast<int>(state.range(2)) | 0x1;
+    vector<int> line_starts;
+    vector<int> buffer(jittered.lineStarts.size());
+    for (auto _ : state) {
+        line_starts = jittered.lineStarts;
+        smooth_line_starts(line_starts, kernel_size, buffer);
+        benchmark::DoNotOptimize(line_starts.data());
+    }
+    set_rows_processed(state, jittered.frame.rows);
+}
+
+// Shifts all rows of a BGR frame by their known jitter.
+void BM_Shift(benchmark::State &state) {
+    const JitteredFrame jittered = create_jittered_frame(get_benchmark_frame_size(state), FRAME_FORMAT_BGR24);
+    const ProcessingParameters parameters = get_parameters(FRAME_FORMAT_BGR24, COL_RANGES[0]);
+    cv::Mat out(jittered.frame.size(), jittered.frame.type());
+    for (auto _ : state) {
+        shift_rows(jittered.frame, jittered.lineStarts, parameters, out, cv::Range(0, jittered.frame.rows));
+        benchmark::DoNotOptimize(out.data);
+    }
+    set_rows_processed(state, jittered.frame.rows);
+}
+
+/**
+ * The full correct_frame call. The "error" counter is the mean distance (in pixels) between the final line starts and
+ * the known line starts of the synthetic frame, so that a change that makes the detection faster but wrong stands out.
+ */
+void correct_jittered_frame(benchmark::State &state, FrameFormat format) {
+    const JitteredFrame jittered = create_jittered_frame(get_benchmark_frame_size(state), format);
+    const ProcessingParameters parameters = get_parameters(format, static_cast<int>(state.range(2)), static_cast<int>(state.range(3)));
+    DeshakeContext context;
+    cv::Mat out;
+    for (auto _ : state) {
+        correct_frame(jittered.frame, parameters, context, out);
+        benchmark::DoNotOptimize(out.data);
+    }
+    set_rows_processed(state, jittered.frame.rows);
+
+    double error = 0;
+    for (size_t y = 0; y < jittered.lineStarts.size(); ++y) {
+        error += context.lineStarts[y] == MISSING ? parameters.colRange : std::abs(context.lineStarts[y] - jittered.lineStarts[y]);
+    }
+    state.counters["error"] = error / jittered.lineStarts.size();
+}
+
+void BM_CorrectFrame(benchmark::State &state) { correct_jittered_frame(state, FRAME_FORMAT_BGR24); }
+
+void BM_CorrectFrameYuv420p(benchmark::State &state) { correct_jittered_frame(state, FRAME_FORMAT_YUV420P); }
+
+/**
+ * The full correct_frame call (BGR frames, default parameters) with the row bands on the given number of OpenCV
+ * threads. Comparing threads:1 with the other counts gives the latency gain of the row bands on the machine that runs
+ * the benchmark.
+ */
+void BM_CorrectFrameThreads(benchmark::State &state) {
+    const JitteredFrame jittered = create_jittered_frame(get_benchmark_frame_size(state), FRAME_FORMAT_BGR24);
+    const ProcessingParameters parameters = get_parameters(FRAME_FORMAT_BGR24, 2 * ProcessingParameters::DEFAULT_PURE_BLACK_WIDTH);
+    const int threads = static_cast<int>(state.range(2));
+    const int previous_threads = cv::getNumThreads();
+    // cv::setNumThreads(0) runs cv::parallel_for_ on the calling thread.
+    cv::setNumThreads(threads == 1 ? 0 : threads);
+
+    DeshakeContext context;
+    cv::Mat out;
+    for (auto _ : state) {
+        correct_frame(jittered.frame, parameters, context, out);
+        benchmark::DoNotOptimize(out.data);
+    }
+    set_rows_processed(state, jittered.frame.rows);
+    cv::setNumThreads(previous_threads);
+}
+
+} // namespace
+
+BENCHMARK(BM_CvtColor)->Apply(geometry_col_range_args);
+BENCHMARK(BM_ScanFused)->Apply(geometry_col_range_args);
+BENCHMARK(BM_ScanGray)->Apply(geometry_col_range_args);
+BENCHMARK(BM_ScanTransposed)->Apply(geometry_col_range_args);
+BENCHMARK(BM_Denoise)->Apply(geometry_args);
+BENCHMARK(BM_Merge)->Apply(geometry_args);
+BENCHMARK(BM_FillGaps)->Apply(geometry_args);
+BENCHMARK(BM_Smooth)->Apply(geometry_kernel_args);
+BENCHMARK(BM_Shift)->Apply(geometry_args);
+BENCHMARK(BM_CorrectFrame)->Apply(geometry_col_range_kernel_args)->UseRealTime();
+BENCHMARK(BM_CorrectFrameYuv420p)->Apply(geometry_col_range_kernel_args)->UseRealTime();
+BENCHMARK(BM_CorrectFrameThreads)->Apply(geometry_threads_args)->UseRealTime();
+
+BENCHMARK_MAIN();
@@ -0,0 +1,232 @@
+#include "estimate_parameters.h"
+#include "correct_frame.h"
+#include "correct_frame_internal.h"
+#include "scan_kernels.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <vector>
+
+using std::vector;
+
+namespace {
+
+long get_sample_frame_count(cv::VideoCapture &videoCapture) {
+    const long frame_count = static_cast<long>(videoCapture.get(cv::CAP_PROP_FRAME_COUNT));
+    if (frame_count <= 0) {
+        throw std::runtime_error("The number of frames of the input video is unknown");
+    }
+    return frame_count;
+}
+
+/**
+ * Seeks to the i-th of sample_frames frames spread evenly over the video and reads it. Returns false if the frame does
+ * not exist (the frame count may be an estimate, i.e. the last sample frames may not exist).
+ */
+bool read_sample_frame(cv::VideoCapture &videoCapture, int i, int sample_frames, long frame_count, cv::Mat &img) {
+    const long frame = static_cast<long>((i + 0.5) * frame_count / sample_frames);
+    if (!videoCapture.set(cv::CAP_PROP_POS_FRAMES, static_cast<double>(frame))) {
+        throw std::runtime_error("The input video does not support seeking");
+    }
+    return videoCapture.grab() && videoCapture.retrieve(img);
+}
+
+/**
+ * Returns the index of the element that is the given percentile of count sorted values.
+ */
+size_t get_percentile_index(size_t count, double percentile) {
+    return std::min(count - 1, static_cast<size_t>(std::ceil(percentile / 100.0 * count)) - 1);
+}
+
+/**
+ * Returns the given percentile of the values counted in histogram (which must not be empty).
+ */
+int get_histogram_percentile(const vector<long> &histogram, double percentile) {
+    long total = 0;
+    for (long count : histogram) {
+        total += count;
+    }
+    const long index = static_cast<long>(get_percentile_index(static_cast<size_t>(total), percentile));
+    long seen = 0;
+    for (size_t value = 0; value < histogram.size(); ++value) {
+        seen += histogram[value];
+        if (seen > index) {
+            return static_cast<int>(value);
+        }
+    }
+    return static_cast<int>(histogram.size()) - 1;
+}
+
+/**
+ * Adds the luminance of the outermost BORDER_LUMA_COLUMNS columns on both sides of the frame to histogram. The
+ * limited-range Y values of planar YUV frames are mapped to the full range (like pureBlackThreshold).
+ */
+void add_border_luma(const cv::Mat &img, FrameFormat format, vector<long> &histogram) {
+    const bool yuv = is_planar_yuv(format);
+    const cv::Mat luma = yuv ? get_plane(img, format, 0) : img;
+    const int columns = std::min(BORDER_LUMA_COLUMNS, luma.cols / 2);
+
+    auto add = [&](const uint8_t *row, int x) {
+        int value = yuv ? row[x] : bgr_to_luma(row + 3 * x);
+        if (yuv) {
+            value = std::max(0, std::min(255, cvRound((value - YUV_BLACK_LUMA) * (255.0 / 219.0))));
+        }
+        ++histogram[value];
+    };
+    for (int y = 0; y < luma.rows; ++y) {
+        const uint8_t *row = luma.ptr<uint8_t>(y);
+        for (int x = 0; x < columns; ++x) {
+            add(row, x);
+            add(row, luma.cols - 1 - x);
+        }
+    }
+}
+
+/**
+ * Returns the parameters that the sample frames are analyzed with: the borders are scanned over half of the frame width.
+ * The temporal prior and the duplicate detection would only skip work.
+ */
+ProcessingParameters get_sample_parameters(const ProcessingParameters &parameters, int width) {
+    ProcessingParameters sample_parameters = parameters;
+    sample_parameters.colRange = width / 2;
+    sample_parameters.temporalSearchWindow = 0;
+    sample_parameters.detectDuplicateFrames = false;
+    return sample_parameters;
+}
+
+/**
+ * Scans the borders of a sample frame for raw line starts (with sample_parameters, see get_sample_parameters) and adds,
+ * for each raw line start and line end, the column range needed to find it (its distance from the border of the frame
+ * plus one) to distances.
+ */
+void add_line_start_distances(const cv::Mat &img, const ProcessingParameters &sample_parameters, DeshakeContext &context,
+                              vector<int> &distances) {
+    analyze_frame(img, sample_parameters, context);
+
+    // A line start at column x is found with a column range of x + 1. Line ends are relative to the reference point
+    // colRange - 2 * pureBlackWidth of the right-hand strip (see get_raw_line_starts), which makes the needed column
+    // range independent of the scanned range.
+    for (int x : context.rawLineStarts) {
+        if (x != MISSING) {
+            distances.push_back(x + 1);
+        }
+    }
+    for (int x : context.rawLineEnds) {
+        if (x != MISSING) {
+            distances.push_back(2 * sample_parameters.pureBlackWidth - x);
+        }
+    }
+}
+
+} // namespace
+
+ColRangeEstimate estimate_col_range(cv::VideoCapture &videoCapture, const ProcessingParameters &parameters, int sample_frames,
+                                    double percentile) {
+    if (sample_frames < 1) {
+        throw std::invalid_argument("sample_frames must be >= 1");
+    }
+    if (percentile <= 0 || percentile > 100) {
+        throw std::invalid_argument("percentile must be in the range (0, 100]");
+    }
+
+    const long frame_count = get_sample_frame_count(videoCapture);
+    const int width = static_cast<int>(videoCapture.get(cv::CAP_PROP_FRAME_WIDTH));
+    const ProcessingParameters sample_parameters = get_sample_parameters(parameters, width);
+    DeshakeContext context;
+    context.keepRawLineStarts = true;
+
+    vector<int> distances;
+    ColRangeEstimate estimate;
+    cv::Mat img;
+    sample_frames = static_cast<int>(std::min<long>(sample_frames, frame_count));
+    for (int i = 0; i < sample_frames; ++i) {
+        if (!read_sample_frame(videoCapture, i, sample_frames, frame_count, img)) {
+            break;
+        }
+        add_line_start_distances(img, sample_parameters, context, distances);
+        ++estimate.sampledFrames;
+    }
+    estimate.lineStarts = static_cast<long>(distances.size());
+    if (distances.empty()) {
+        return estimate;
+    }
+
+    const size_t index = get_percentile_index(distances.size(), percentile);
+    std::nth_element(distances.begin(), distances.begin() + index, distances.end());
+    estimate.colRange = std::max(1, distances[index]);
+    estimate.maxColRange = *std::max_element(distances.begin() + index, distances.end());
+    return estimate;
+}
+
+ParameterEstimate estimate_parameters(cv::VideoCapture &videoCapture, const ProcessingParameters &parameters, int sample_frames) {
+    if (sample_frames < 1) {
+        throw std::invalid_argument("sample_frames must be >= 1");
+    }
+
+    const long frame_count = get_sample_frame_count(videoCapture);
+    const FrameFormat format = static_cast<FrameFormat>(parameters.frameFormat);
+    ParameterEstimate estimate;
+    estimate.parameters = parameters;
+    estimate.borderLumaHistogram.assign(256, 0);
+
+    // The sample frames are decoded once and kept for both steps, because the line starts can only be detected once the
+    // threshold is known (50 BGR frames of 720x576 take about 62 MB).
+    sample_frames = static_cast<int>(std::min<long>(sample_frames, frame_count));
+    vector<cv::Mat> frames;
+    frames.reserve(static_cast<size_t>(sample_frames));
+    for (int i = 0; i < sample_frames; ++i) {
+        cv::Mat img;
+        if (!read_sample_frame(videoCapture, i, sample_frames, frame_count, img)) {
+            break;
+        }
+        frames.push_back(img);
+    }
+    estimate.sampledFrames = static_cast<int>(frames.size());
+
+    // 1. The pure black threshold must be above the noise of the pure black at the edges of the frame.
+    for (const cv::Mat &img : frames) {
+        add_border_luma(img, format, estimate.borderLumaHistogram);
+    }
+    if (estimate.sampledFrames == 0) {
+        return estimate;
+    }
+    estimate.borderLumaNoise = get_histogram_percentile(estimate.borderLumaHistogram, BORDER_LUMA_PERCENTILE);
+    const int threshold = std::max(1, estimate.borderLumaNoise + PURE_BLACK_THRESHOLD_MARGIN);
+    if (threshold > MAX_ESTIMATED_PURE_BLACK_THRESHOLD) {
+        return estimate;
+    }
+    estimate.parameters.pureBlackThreshold = threshold;
+
+    // 2. The raw line starts found with this threshold give the widths of the black borders.
+    const int frame_width = static_cast<int>(videoCapture.get(cv::CAP_PROP_FRAME_WIDTH));
+    const ProcessingParameters sample_parameters = get_sample_parameters(estimate.parameters, frame_width);
+    DeshakeContext context;
+    context.keepRawLineStarts = true;
+    vector<int> distances;
+    for (const cv::Mat &img : frames) {
+        add_line_start_distances(img, sample_parameters, context, distances);
+    }
+    estimate.lineStarts = static_cast<long>(distances.size());
+    if (distances.empty()) {
+        return estimate;
+    }
+    for (int distance : distances) {
+        const size_t width = static_cast<size_t>(distance - 1);
+        if (width >= estimate.borderWidthHistogram.size()) {
+            estimate.borderWidthHistogram.resize(width + 1, 0);
+        }
+        ++estimate.borderWidthHistogram[width];
+    }
+
+    // The column range is never smaller than the default (double the pure black width), so that rows shifted to either
+    // side are found.
+    const int pure_black_width = std::max(1, get_histogram_percentile(estimate.borderWidthHistogram, 50));
+    const size_t index = get_percentile_index(distances.size(), DEFAULT_COL_RANGE_PERCENTILE);
+    std::nth_element(distances.begin(), distances.begin() + index, distances.end());
+    estimate.parameters.pureBlackWidth = pure_black_width;
+    estimate.parameters.targetLineStart = pure_black_width;
+    estimate.parameters.colRange = std::max(2 * pure_black_width, distances[index]);
+    estimate.valid = true;
+    return estimate;
+}
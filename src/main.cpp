@@ -1,13 +1,17 @@
+#include <algorithm>
 #include <chrono>
 #include <cstdio>
 #include <cstdlib> // putenv / setenv
 #include <ctime>
 #include <cxxopts.hpp>
 #include <fstream>
+#include <iomanip>
 #include <iostream>
+#include <memory>
 #include <opencv2/core/utils/logger.hpp>
 #include <opencv2/videoio.hpp>
 #include <string>
+#include <thread>
 
 #ifdef _WIN32
 #include <fcntl.h>
@@ -16,8 +20,21 @@
 
 #include "ConditionalOStream.h"
 #include "ProcessingParameters.h"
+#include "Profiler.h"
+#include "LineStartsFile.h"
+#include "StdinVideoReader.h"
 #include "StdoutVideoWriter.h"
+#include "estimate_parameters.h"
+#ifdef HAVE_LIBAV
+#include "LibavVideoCapture.h"
+#include "LibavVideoWriter.h"
+#endif
+#include "process_analyze_only.h"
+#include "process_apply_shifts.h"
+#include "process_multi_threaded.h"
+#include "process_preview.h"
 #include "process_single_threaded.h"
+#include "process_sweep.h"
 
 using namespace cv;
 namespace chrono = std::chrono;
@@ -29,6 +46,130 @@ using std::out_of_range;
 using std::stod;
 using std::string;
 
+/**
+ * Returns the fourcc that OpenCV's VideoWriter uses for the given --codec value (only used if vhs-deshaker was built
+ * without the FFmpeg libraries). Any four character code is accepted as well. Returns -1 for unknown codecs.
+ */
+int get_fourcc(const string &codec) {
+    if (codec == "huffyuv") {
+        return VideoWriter::fourcc('H', 'F', 'Y', 'U');
+    } else if (codec == "ffv1") {
+        return VideoWriter::fourcc('F', 'F', 'V', '1');
+    } else if (codec == "x264" || codec == "libx264") {
+        return VideoWriter::fourcc('H', '2', '6', '4');
+    } else if (codec.size() == 4) {
+        return VideoWriter::fourcc(codec[0], codec[1], codec[2], codec[3]);
+    }
+    return -1;
+}
+
+/**
+ * Opens an input video file. The frames are decoded with FFmpeg's libraries directly if possible, otherwise OpenCV is
+ * used (BGR frames only). Returns nullptr if the file cannot be opened.
+ */
+VideoCapture *open_video_file(const string &filename, int decoder_threads, FrameFormat frame_format) {
+    VideoCapture *videoCapture = nullptr;
+#ifdef HAVE_LIBAV
+    videoCapture = new LibavVideoCapture(filename, decoder_threads, frame_format);
+    if (!videoCapture->isOpened()) {
+        delete videoCapture;
+        videoCapture = nullptr;
+    }
+#endif
+    if (videoCapture == nullptr && !is_planar_yuv(frame_format)) {
+        videoCapture = new VideoCapture(filename);
+    }
+    if (videoCapture != nullptr && !videoCapture->isOpened()) {
+        delete videoCapture;
+        videoCapture = nullptr;
+    }
+    return videoCapture;
+}
+
+/**
+ * Estimates the parameters from sample frames of the input video (--estimate-parameters) and prints them together with
+ * the histograms they are based on. Returns the exit code.
+ */
+int print_estimated_parameters(const string &input_file, int decoder_threads, const ProcessingParameters &parameters, int sample_frames) {
+    const FrameFormat frame_format = static_cast<FrameFormat>(parameters.frameFormat);
+    std::unique_ptr<VideoCapture> sampleCapture(open_video_file(input_file, decoder_threads, frame_format));
+    if (!sampleCapture) {
+        cerr << "Could not open input file" << endl;
+        return 1;
+    }
+    ParameterEstimate estimate;
+    try {
+        estimate = estimate_parameters(*sampleCapture, parameters, sample_frames);
+    } catch (const std::exception &e) {
+        cerr << "ERROR: Could not estimate the parameters: " << e.what() << endl;
+        return 1;
+    }
+    sampleCapture.reset();
+
+    std::cout << "Sampled frames: " << estimate.sampledFrames << endl;
+    if (estimate.borderLumaNoise == -1) {
+        cerr << "ERROR: No frames could be read from the input video." << endl;
+        return 1;
+    }
+    std::cout << "Border luminance: " << estimate.borderLumaNoise << " (" << BORDER_LUMA_PERCENTILE << "th percentile of the outermost "
+              << BORDER_LUMA_COLUMNS << " columns)" << endl;
+    if (estimate.lineStarts > 0) {
+        // Only the widths of at least 0.5% of the line starts are listed.
+        std::cout << "Black border widths (" << estimate.lineStarts << " line starts):" << endl;
+        for (size_t width = 0; width < estimate.borderWidthHistogram.size(); ++width) {
+            const double percentage = 100.0 * estimate.borderWidthHistogram[width] / estimate.lineStarts;
+            if (percentage >= 0.5) {
+                std::cout << "  " << std::setw(4) << width << ": " << std::setw(5) << std::fixed << std::setprecision(1) << percentage
+                          << "% " << string(static_cast<size_t>(percentage / 2.5 + 0.5), '#') << endl;
+            }
+        }
+        std::cout.unsetf(std::ios::fixed);
+        std::cout << std::setprecision(6);
+    }
+    if (!estimate.valid) {
+        if (estimate.lineStarts == 0 && estimate.borderLumaNoise + PURE_BLACK_THRESHOLD_MARGIN <= MAX_ESTIMATED_PURE_BLACK_THRESHOLD) {
+            cerr << "ERROR: No line starts found in the sample frames." << endl;
+        } else {
+            cerr << "ERROR: The borders of the sample frames are not black." << endl;
+        }
+        return 1;
+    }
+
+    const ProcessingParameters &recommended = estimate.parameters;
+    std::cout << "Recommended parameters:" << endl;
+    std::cout << "  Column range:                     " << recommended.colRange << endl;
+    std::cout << "  Target line start:                " << recommended.targetLineStart << endl;
+    std::cout << "  Pure black width:                 " << recommended.pureBlackWidth << endl;
+    std::cout << "  Pure black threshold:             " << recommended.pureBlackThreshold << endl;
+    std::cout << "Options: -c " << recommended.colRange << " -t " << recommended.targetLineStart << " -w " << recommended.pureBlackWidth
+              << " -p " << recommended.pureBlackThreshold << endl;
+    return 0;
+}
+
+/**
+ * Creates the writer of an output video file. The video is encoded with FFmpeg's libraries directly if possible,
+ * otherwise OpenCV is used (BGR frames only). Errors and warnings are printed, the caller has to check isOpened().
+ */
+VideoWriter *create_video_writer(const string &filename, const string &codec, const string &encoder_options, int encoder_threads,
+                                 double fps, const cv::Size &frameSize, FrameFormat frame_format, const string &copy_streams_from,
+                                 int &copied_streams) {
+#ifdef HAVE_LIBAV
+    LibavVideoWriter *libavVideoWriter =
+        new LibavVideoWriter(filename, codec, encoder_options, encoder_threads, fps, frameSize, frame_format, copy_streams_from);
+    if (!libavVideoWriter->isOpened()) {
+        cerr << "ERROR: " << libavVideoWriter->getLastError() << endl;
+    }
+    for (const string &warning : libavVideoWriter->getWarnings()) {
+        cerr << "WARNING: " << warning << endl;
+    }
+    copied_streams = libavVideoWriter->getCopiedStreamCount();
+    return libavVideoWriter;
+#else
+    bool isColor = true;
+    return new VideoWriter(filename, get_fourcc(codec), fps, frameSize, isColor);
+#endif
+}
+
 // TODO: Add --col-range commandline parameter
 // TODO: Replace the positional framerate parameter with --framerate option
 int main(int argc, char *argv[]) {
@@ -38,15 +179,38 @@ int main(int argc, char *argv[]) {
     // clang-format off
     options.add_options()
         //("d,debug", "Enable debugging")
-        ("i,input", "Input video", cxxopts::value<std::string>())
-        ("o,output", "Output video", cxxopts::value<std::string>())
+        ("i,input", "Input video, stdin = read raw frames or a Y4M stream from stdin", cxxopts::value<std::string>())
+        ("o,output", "Output video, stdout = write raw frames to stdout", cxxopts::value<std::string>())
+        ("y4m", "Write a YUV4MPEG2 (Y4M) stream instead of raw frames to stdout")
         ("f,framerate", "Enforce this framerate for the output video", cxxopts::value<double>())
         ("c,colrange", "Column range, -1 = use double the value given by -w", cxxopts::value<int>()->default_value(std::to_string(ProcessingParameters::DEFAULT_COL_RANGE)))
+        ("auto-colrange", "Estimate the column range from sample frames of the input video (overrides -c)")
+        ("estimate-parameters", "Only estimate the column range, pure black width and pure black threshold from sample frames of the input video and print them (no output video)")
+        ("sample-frames", "Number of sample frames for --auto-colrange and --estimate-parameters", cxxopts::value<int>()->default_value(std::to_string(DEFAULT_SAMPLE_FRAMES)))
         ("t,target-line-start", "Target line start, -1 = use same value as given by -w", cxxopts::value<int>()->default_value(std::to_string(ProcessingParameters::DEFAULT_TARGET_LINE_START)))
         ("w,pure-black-width", "Pure black area width", cxxopts::value<int>()->default_value(std::to_string(ProcessingParameters::DEFAULT_PURE_BLACK_WIDTH)))
         ("p,pure-black-threshold", "Pure black threshold", cxxopts::value<int>()->default_value(std::to_string(ProcessingParameters::DEFAULT_PURE_BLACK_THRESHOLD)))
         ("m,min-line-start-segment-length", "Min line start segment length", cxxopts::value<int>()->default_value(std::to_string(ProcessingParameters::DEFAULT_MIN_LINE_START_SEGMENT_LENGTH)))
         ("k,line-start-smoothing-kernel-size", "Line start smoothing kernel size", cxxopts::value<int>()->default_value(std::to_string(ProcessingParameters::DEFAULT_LINE_START_SMOOTHING_KERNEL_SIZE)))
+        ("scan-method", "Line start scan method: fused or gray", cxxopts::value<std::string>()->default_value("fused"))
+        ("detect-duplicates", "Reuse the line starts of the previous frame if the borders of a frame are identical to the previous frame's (requires --threads 1)")
+        ("temporal-window", "Search the borders only this many columns around the line starts of the previous frame, 0 = scan the whole column range (requires --threads 1)", cxxopts::value<int>()->default_value(std::to_string(ProcessingParameters::DEFAULT_TEMPORAL_SEARCH_WINDOW)))
+        ("pix-fmt", "Pixel format used for processing: bgr24, yuv420p or yuv422p (YUV only if built with FFmpeg libraries)", cxxopts::value<std::string>()->default_value("bgr24"))
+        ("size", "Frame size of raw input from stdin, e.g. 720x576", cxxopts::value<std::string>())
+        ("decoder-threads", "Number of decoder threads, 0 = automatic (only if built with FFmpeg libraries)", cxxopts::value<int>()->default_value("0"))
+        ("codec", "Output video codec: huffyuv, ffv1, x264, x265 or any other FFmpeg encoder name", cxxopts::value<std::string>()->default_value("huffyuv"))
+        ("encoder-options", "Encoder options as comma separated key=value pairs, e.g. preset=slow,crf=18 (only if built with FFmpeg libraries)", cxxopts::value<std::string>()->default_value(""))
+        ("encoder-threads", "Number of encoder threads, 0 = automatic (only if built with FFmpeg libraries)", cxxopts::value<int>()->default_value("0"))
+        ("copy-streams", "Copy the audio, subtitle and timecode streams of the input video into the output video (only if built with FFmpeg libraries)")
+        ("threads", "Number of worker threads, 0 = use all CPU cores", cxxopts::value<int>()->default_value("1"))
+        ("queue-depth", "Number of frames that are read ahead and written behind with --threads 1, 0 = read and write synchronously", cxxopts::value<int>()->default_value("4"))
+        ("huge-pages", "Allocate the frame buffers with transparent huge pages (Linux only)")
+        ("profile", "Measure the time of each processing stage and write a report (totals, means, p50 and p99 latencies) to this JSON file", cxxopts::value<std::string>())
+        ("analyze-only", "Only detect the line starts and write them to the output file (a line-starts file) instead of a corrected video")
+        ("store-raw-line-starts", "With --analyze-only, also store the raw line starts and segment sizes of each row")
+        ("sweep", "Correct the video with each parameter set of this file in a single decoding pass and print statistics of each set. With -o, one output video per set is written", cxxopts::value<std::string>())
+        ("preview", "Only correct short bursts of frames at this many positions spread over the input video and write them next to the input frames, as a video or (if the output file is a .png, .jpg, .bmp or .tif image) as an image grid", cxxopts::value<int>())
+        ("apply-shifts", "Shift the rows by the line starts from this line-starts file (see --analyze-only) instead of detecting them", cxxopts::value<std::string>())
         ("h,help", "Print usage");
     // clang-format on
 
@@ -68,7 +232,8 @@ int main(int argc, char *argv[]) {
         std::cerr << "ERROR: Input file must be specified with -i" << std::endl;
         return 1;
     }
-    if (result.count("output") == 0) {
+    bool estimate_only = result.count("estimate-parameters") > 0;
+    if (result.count("output") == 0 && !estimate_only && result.count("sweep") == 0) {
         std::cerr << "ERROR: Output file must be specified with -o" << std::endl;
         return 1;
     }
@@ -90,6 +255,18 @@ int main(int argc, char *argv[]) {
         std::cerr << "ERROR: Column range can only be specified once" << std::endl;
         return 1;
     }
+    if (result.count("auto-colrange") > 1) {
+        std::cerr << "ERROR: Auto column range can only be specified once" << std::endl;
+        return 1;
+    }
+    if (result.count("estimate-parameters") > 1) {
+        std::cerr << "ERROR: Estimate parameters can only be specified once" << std::endl;
+        return 1;
+    }
+    if (result.count("sample-frames") > 1) {
+        std::cerr << "ERROR: Number of sample frames can only be specified once" << std::endl;
+        return 1;
+    }
     if (result.count("target-line-start") > 1) {
         std::cerr << "ERROR: Target line start can only be specified once" << std::endl;
         return 1;
@@ -110,6 +287,121 @@ int main(int argc, char *argv[]) {
         std::cerr << "ERROR: Line start smoothing kernel size can only be specified once" << std::endl;
         return 1;
     }
+    if (result.count("scan-method") > 1) {
+        std::cerr << "ERROR: Scan method can only be specified once" << std::endl;
+        return 1;
+    }
+    if (result.count("detect-duplicates") > 1) {
+        std::cerr << "ERROR: Detect duplicates can only be specified once" << std::endl;
+        return 1;
+    }
+    if (result.count("temporal-window") > 1) {
+        std::cerr << "ERROR: Temporal window can only be specified once" << std::endl;
+        return 1;
+    }
+    if (result.count("pix-fmt") > 1) {
+        std::cerr << "ERROR: Pixel format can only be specified once" << std::endl;
+        return 1;
+    }
+    if (result.count("y4m") > 1) {
+        std::cerr << "ERROR: Y4M output can only be specified once" << std::endl;
+        return 1;
+    }
+    if (result.count("size") > 1) {
+        std::cerr << "ERROR: Frame size can only be specified once" << std::endl;
+        return 1;
+    }
+    if (result.count("decoder-threads") > 1) {
+        std::cerr << "ERROR: Number of decoder threads can only be specified once" << std::endl;
+        return 1;
+    }
+    if (result.count("codec") > 1) {
+        std::cerr << "ERROR: Codec can only be specified once" << std::endl;
+        return 1;
+    }
+    if (result.count("encoder-options") > 1) {
+        std::cerr << "ERROR: Encoder options can only be specified once" << std::endl;
+        return 1;
+    }
+    if (result.count("encoder-threads") > 1) {
+        std::cerr << "ERROR: Number of encoder threads can only be specified once" << std::endl;
+        return 1;
+    }
+    if (result.count("copy-streams") > 1) {
+        std::cerr << "ERROR: Copy streams can only be specified once" << std::endl;
+        return 1;
+    }
+    if (result.count("threads") > 1) {
+        std::cerr << "ERROR: Number of threads can only be specified once" << std::endl;
+        return 1;
+    }
+    if (result.count("queue-depth") > 1) {
+        std::cerr << "ERROR: Queue depth can only be specified once" << std::endl;
+        return 1;
+    }
+    if (result.count("huge-pages") > 1) {
+        std::cerr << "ERROR: Huge pages can only be specified once" << std::endl;
+        return 1;
+    }
+    if (result.count("profile") > 1) {
+        std::cerr << "ERROR: Only one profile file can be specified" << std::endl;
+        return 1;
+    }
+    if (result.count("analyze-only") > 1) {
+        std::cerr << "ERROR: Analyze only can only be specified once" << std::endl;
+        return 1;
+    }
+    if (result.count("store-raw-line-starts") > 1) {
+        std::cerr << "ERROR: Store raw line starts can only be specified once" << std::endl;
+        return 1;
+    }
+    if (result.count("apply-shifts") > 1) {
+        std::cerr << "ERROR: Only one line-starts file can be applied" << std::endl;
+        return 1;
+    }
+    if (result.count("sweep") > 1) {
+        std::cerr << "ERROR: Only one sweep file can be specified" << std::endl;
+        return 1;
+    }
+    if (result.count("preview") > 1) {
+        std::cerr << "ERROR: Preview can only be specified once" << std::endl;
+        return 1;
+    }
+    bool analyze_only = result.count("analyze-only") > 0;
+    bool store_raw_line_starts = result.count("store-raw-line-starts") > 0;
+    if (store_raw_line_starts && !analyze_only) {
+        cerr << "WARNING: store-raw-line-starts is ignored because analyze-only is not specified." << endl;
+    }
+    string apply_shifts_file;
+    if (result.count("apply-shifts") > 0) {
+        apply_shifts_file = result["apply-shifts"].as<string>();
+        if (analyze_only) {
+            cerr << "ERROR: analyze-only and apply-shifts cannot be combined" << endl;
+            return 1;
+        }
+    }
+    string sweep_file;
+    if (result.count("sweep") > 0) {
+        sweep_file = result["sweep"].as<string>();
+        if (analyze_only || !apply_shifts_file.empty()) {
+            cerr << "ERROR: sweep cannot be combined with analyze-only or apply-shifts" << endl;
+            return 1;
+        }
+    }
+    int preview_positions = 0;
+    if (result.count("preview") > 0) {
+        preview_positions = result["preview"].as<int>();
+        if (preview_positions < 1) {
+            cerr << "ERROR: Invalid number of preview positions (must be a positive number)" << endl;
+            return 1;
+        }
+        if (analyze_only || !apply_shifts_file.empty() || !sweep_file.empty()) {
+            cerr << "ERROR: preview cannot be combined with analyze-only, apply-shifts or sweep" << endl;
+            return 1;
+        }
+    }
+    bool huge_pages = result.count("huge-pages") > 0;
+    string profile_file = result.count("profile") > 0 ? result["profile"].as<string>() : "";
 
     // Check that the framerate is a positive number.
     double framerate = -1;
@@ -141,6 +433,80 @@ int main(int argc, char *argv[]) {
         }
     }
 
+    // Check that at least one frame is sampled.
+    int sample_frames = result["sample-frames"].as<int>();
+    if (sample_frames < 1) {
+        cerr << "ERROR: Invalid number of sample frames (must be a positive number)" << endl;
+        return 1;
+    }
+
+    // Check that the temporal window is not negative (0 means no temporal prior).
+    int temporal_window = result["temporal-window"].as<int>();
+    if (temporal_window < 0) {
+        cerr << "ERROR: Invalid temporal window (must be 0 or a positive number)" << endl;
+        return 1;
+    }
+
+    // Check that the number of threads is not negative (0 means auto-detect).
+    int num_threads = result["threads"].as<int>();
+    if (num_threads < 0) {
+        cerr << "ERROR: Invalid number of threads (must be 0 or a positive number)" << endl;
+        return 1;
+    }
+    if (num_threads == 0) {
+        num_threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    if (temporal_window > 0 && num_threads > 1) {
+        cerr << "ERROR: temporal-window requires --threads 1, because the frames must be processed in order" << endl;
+        return 1;
+    }
+    if (result.count("detect-duplicates") > 0 && num_threads > 1) {
+        cerr << "ERROR: detect-duplicates requires --threads 1, because the frames must be processed in order" << endl;
+        return 1;
+    }
+
+    // Check that the queue depth is not negative (0 means no read-ahead/write-behind).
+    int queue_depth = result["queue-depth"].as<int>();
+    if (queue_depth < 0) {
+        cerr << "ERROR: Invalid queue depth (must be 0 or a positive number)" << endl;
+        return 1;
+    }
+
+    // Check that the number of decoder threads is not negative (0 means automatic).
+    int decoder_threads = result["decoder-threads"].as<int>();
+    if (decoder_threads < 0) {
+        cerr << "ERROR: Invalid number of decoder threads (must be 0 or a positive number)" << endl;
+        return 1;
+    }
+#ifndef HAVE_LIBAV
+    if (result.count("decoder-threads") > 0) {
+        cerr << "WARNING: decoder-threads is ignored because vhs-deshaker was built without the FFmpeg libraries." << endl;
+    }
+#endif
+
+    // Check that the number of encoder threads is not negative (0 means automatic).
+    int encoder_threads = result["encoder-threads"].as<int>();
+    if (encoder_threads < 0) {
+        cerr << "ERROR: Invalid number of encoder threads (must be 0 or a positive number)" << endl;
+        return 1;
+    }
+    string codec = result["codec"].as<string>();
+    string encoder_options = result["encoder-options"].as<string>();
+#ifndef HAVE_LIBAV
+    if (get_fourcc(codec) == -1) {
+        cerr << "ERROR: Invalid codec (must be huffyuv, ffv1, x264 or a fourcc if built without the FFmpeg libraries)" << endl;
+        return 1;
+    }
+    if (result.count("encoder-options") > 0 || result.count("encoder-threads") > 0) {
+        cerr << "WARNING: encoder-options and encoder-threads are ignored because vhs-deshaker was built without the FFmpeg libraries."
+             << endl;
+    }
+    if (result.count("copy-streams") > 0) {
+        cerr << "WARNING: copy-streams is ignored because vhs-deshaker was built without the FFmpeg libraries." << endl;
+    }
+#endif
+    bool copy_streams = result.count("copy-streams") > 0;
+
     // Fill the processing parameters with the values from the commandline options.
     ProcessingParameters parameters;
 
@@ -150,6 +516,50 @@ int main(int argc, char *argv[]) {
     parameters.pureBlackThreshold = result["pure-black-threshold"].as<int>();
     parameters.minLineStartSegmentLength = result["min-line-start-segment-length"].as<int>();
     parameters.lineStartSmoothingKernelSize = result["line-start-smoothing-kernel-size"].as<int>() | 0x1;
+    parameters.temporalSearchWindow = temporal_window;
+    parameters.detectDuplicateFrames = result.count("detect-duplicates") > 0;
+
+    string scan_method = result["scan-method"].as<string>();
+    if (scan_method == "fused") {
+        parameters.scanMethod = ProcessingParameters::SCAN_METHOD_FUSED;
+    } else if (scan_method == "gray") {
+        parameters.scanMethod = ProcessingParameters::SCAN_METHOD_GRAY;
+    } else {
+        cerr << "ERROR: Invalid scan method (must be fused or gray)" << endl;
+        return 1;
+    }
+
+    FrameFormat frame_format;
+    if (!parse_frame_format(result["pix-fmt"].as<string>(), frame_format)) {
+        cerr << "ERROR: Invalid pixel format (must be bgr24, yuv420p or yuv422p)" << endl;
+        return 1;
+    }
+    parameters.frameFormat = frame_format;
+
+    // Check that the frame size of raw input has the format WIDTHxHEIGHT.
+    cv::Size raw_frame_size;
+    if (result.count("size") > 0) {
+        string size = result["size"].as<string>();
+        char separator = 0;
+        char rest = 0;
+        if (sscanf(size.c_str(), "%d%c%d%c", &raw_frame_size.width, &separator, &raw_frame_size.height, &rest) != 3 || separator != 'x' ||
+            raw_frame_size.width <= 0 || raw_frame_size.height <= 0) {
+            cerr << "ERROR: Invalid frame size (must be WIDTHxHEIGHT, e.g. 720x576)" << endl;
+            return 1;
+        }
+    }
+
+    // Parameters that are not given in the sweep file are taken from the commandline (before -1 is resolved, because
+    // the sets may have a different pure black width).
+    std::vector<SweepSet> sweep_sets;
+    if (!sweep_file.empty()) {
+        try {
+            sweep_sets = read_sweep_file(sweep_file, parameters);
+        } catch (const std::exception &e) {
+            cerr << "ERROR: " << e.what() << endl;
+            return 1;
+        }
+    }
 
     if (parameters.colRange == -1) {
         parameters.colRange = 2 * parameters.pureBlackWidth;
@@ -166,9 +576,77 @@ int main(int argc, char *argv[]) {
 #endif
 
     string input_file = result["input"].as<string>();
-    string output_file = result["output"].as<string>();
+    string output_file = result.count("output") > 0 ? result["output"].as<string>() : "";
 
     bool piping_to_stdout = (output_file == "stdout");
+    bool sweep_statistics_only = !sweep_sets.empty() && output_file.empty();
+    bool preview_image = preview_positions > 0 && is_preview_image_file(output_file);
+    bool reading_from_stdin = (input_file == "stdin");
+    if (piping_to_stdout && copy_streams) {
+        cerr << "WARNING: copy-streams is ignored because raw video output to stdout has no container for other streams." << endl;
+        copy_streams = false;
+    }
+    if (reading_from_stdin && copy_streams) {
+        cerr << "WARNING: copy-streams is ignored because the input from stdin cannot be read twice." << endl;
+        copy_streams = false;
+    }
+    bool y4m_output = result.count("y4m") > 0;
+    if (!piping_to_stdout && y4m_output) {
+        cerr << "WARNING: y4m is ignored because the output is not written to stdout." << endl;
+    }
+    if (preview_positions > 0 && reading_from_stdin) {
+        cerr << "ERROR: preview cannot seek in the input from stdin" << endl;
+        return 1;
+    }
+    if (preview_positions > 0 && copy_streams) {
+        cerr << "WARNING: copy-streams is ignored because the preview only contains some frames of the input video." << endl;
+        copy_streams = false;
+    }
+    bool auto_col_range = result.count("auto-colrange") > 0;
+    if (estimate_only && reading_from_stdin) {
+        cerr << "ERROR: estimate-parameters cannot sample frames from stdin" << endl;
+        return 1;
+    }
+    if (auto_col_range && reading_from_stdin) {
+        cerr << "ERROR: auto-colrange cannot sample frames from stdin" << endl;
+        return 1;
+    }
+    if (auto_col_range && result.count("colrange") > 0) {
+        cerr << "WARNING: colrange is ignored because auto-colrange is specified." << endl;
+    }
+    if (!reading_from_stdin && result.count("size") > 0) {
+        cerr << "WARNING: size is ignored because the input is not read from stdin." << endl;
+    }
+    if (analyze_only && piping_to_stdout) {
+        cerr << "ERROR: The line starts of analyze-only cannot be written to stdout." << endl;
+        return 1;
+    }
+    if (analyze_only && num_threads > 1) {
+        cerr << "WARNING: threads is ignored because analyze-only only runs the line-start detection, which is parallelized already."
+             << endl;
+        num_threads = 1;
+    }
+    if (!sweep_sets.empty() && piping_to_stdout) {
+        cerr << "ERROR: The output videos of sweep cannot be written to stdout." << endl;
+        return 1;
+    }
+    if (!sweep_sets.empty() && auto_col_range) {
+        cerr << "WARNING: auto-colrange is ignored because the column range of each parameter set is given by the sweep file." << endl;
+        auto_col_range = false;
+    }
+    if (!sweep_sets.empty() && num_threads > 1) {
+        cerr << "WARNING: threads is ignored because sweep corrects each frame with all parameter sets in parallel." << endl;
+        num_threads = 1;
+    }
+    if (preview_positions > 0 && num_threads > 1) {
+        cerr << "WARNING: threads is ignored because preview only corrects a few frames." << endl;
+        num_threads = 1;
+    }
+    if (!apply_shifts_file.empty() && num_threads > 1) {
+        cerr << "WARNING: threads is ignored because apply-shifts only runs the row shifting, which is parallelized already." << endl;
+        num_threads = 1;
+    }
+
     ConditionalOStream cout(std::cout, !piping_to_stdout);
     cout << "vhs-deshaker " << VERSION << endl << endl;
 
@@ -182,7 +660,7 @@ int main(int argc, char *argv[]) {
     }
 
     // Check if the input file exists and can be opened.
-    {
+    if (!reading_from_stdin) {
         ifstream input_file_stream(input_file);
         if (!input_file_stream.good()) {
             cerr << "ERROR: Input file cannot be opened." << endl;
@@ -191,17 +669,87 @@ int main(int argc, char *argv[]) {
         input_file_stream.close();
     }
 
+    if (estimate_only) {
+        return print_estimated_parameters(input_file, decoder_threads, parameters, sample_frames);
+    }
+
     cout << "Processing file " << input_file << " ..." << endl;
-    VideoCapture videoCapture(input_file);
-    if (!videoCapture.isOpened()) {
+    VideoCapture *videoCapture = nullptr;
+    if (reading_from_stdin) {
+#ifdef _WIN32
+        _setmode(_fileno(stdin), _O_BINARY);
+#endif
+        StdinVideoReader *stdinVideoReader = new StdinVideoReader(raw_frame_size, frame_format);
+        if (!stdinVideoReader->isOpened()) {
+            cerr << "ERROR: " << stdinVideoReader->getLastError() << endl;
+            return 1;
+        }
+
+        // The pixel format of Y4M input is given by the stream header.
+        if (stdinVideoReader->isY4M() && stdinVideoReader->getFrameFormat() != frame_format) {
+            if (result.count("pix-fmt") > 0) {
+                cerr << "ERROR: The Y4M input has pixel format " << frame_format_name(stdinVideoReader->getFrameFormat())
+                     << ", which does not match the specified pixel format." << endl;
+                return 1;
+            }
+            frame_format = stdinVideoReader->getFrameFormat();
+            parameters.frameFormat = frame_format;
+        }
+        videoCapture = stdinVideoReader;
+    }
+    if (videoCapture == nullptr) {
+        videoCapture = open_video_file(input_file, decoder_threads, frame_format);
+    }
+    if (videoCapture == nullptr || !videoCapture->isOpened()) {
         cerr << "Could not open input file" << endl;
         return 1;
     }
 
+    // Planar YUV frames can only be decoded and encoded with the FFmpeg libraries, because OpenCV only supports BGR frames.
+    // Without them, planar YUV is only supported for frames from stdin to stdout.
+#ifndef HAVE_LIBAV
+    if (is_planar_yuv(frame_format) && !(reading_from_stdin && piping_to_stdout)) {
+        cerr << "ERROR: Pixel format " << frame_format_name(frame_format)
+             << " requires vhs-deshaker to be built with the FFmpeg libraries (unless reading from stdin and writing to stdout)." << endl;
+        return 1;
+    }
+#endif
+
+    // The sample frames for the column range estimation are read with a separate capture, so that the processing still
+    // starts with the first frame.
+    if (auto_col_range) {
+        std::unique_ptr<VideoCapture> sampleCapture(open_video_file(input_file, decoder_threads, frame_format));
+        if (!sampleCapture) {
+            cerr << "Could not open input file" << endl;
+            return 1;
+        }
+        ColRangeEstimate estimate;
+        try {
+            estimate = estimate_col_range(*sampleCapture, parameters, sample_frames);
+        } catch (const std::exception &e) {
+            cerr << "ERROR: Could not estimate the column range: " << e.what() << endl;
+            return 1;
+        }
+        // Closes the input file before it is opened again for the processing.
+        sampleCapture.reset();
+
+        if (estimate.colRange == -1) {
+            cerr << "WARNING: No line starts found in " << estimate.sampledFrames << " sample frames, using column range "
+                 << parameters.colRange << "." << endl;
+            auto_col_range = false;
+        } else {
+            parameters.colRange = estimate.colRange;
+            cout << "Estimated column range: " << estimate.colRange << " (covers " << DEFAULT_COL_RANGE_PERCENTILE << "% of "
+                 << estimate.lineStarts << " line starts in " << estimate.sampledFrames << " sample frames, all are covered by "
+                 << estimate.maxColRange << ")" << endl;
+        }
+    }
+
     double fps = -1;
     if (framerate <= 0) {
-        fps = videoCapture.get(CAP_PROP_FPS);
-        if (fps <= 0) {
+        fps = videoCapture->get(CAP_PROP_FPS);
+        // The frame rate is irrelevant for the line starts.
+        if (fps <= 0 && !analyze_only && !sweep_statistics_only && !preview_image) {
             cerr << "Could not get framerate from input file. Please provide a framerate manually." << endl;
             return 1;
         }
@@ -209,50 +757,175 @@ int main(int argc, char *argv[]) {
         fps = framerate;
     }
 
-    int fourcc = VideoWriter::fourcc('H', 'F', 'Y', 'U');
-    cv::Size frameSize(videoCapture.get(CAP_PROP_FRAME_WIDTH), videoCapture.get(CAP_PROP_FRAME_HEIGHT));
-    bool isColor = true;
+    cv::Size frameSize(videoCapture->get(CAP_PROP_FRAME_WIDTH), videoCapture->get(CAP_PROP_FRAME_HEIGHT));
+
+    // The line starts to apply must have been detected on frames of the same size. The number of frames is checked
+    // while processing, because the frame count reported for the input video may be an estimate.
+    LineStartsReader *lineStartsReader = nullptr;
+    if (!apply_shifts_file.empty()) {
+        lineStartsReader = new LineStartsReader(apply_shifts_file);
+        if (!lineStartsReader->isOpened()) {
+            cerr << "ERROR: " << lineStartsReader->getLastError() << endl;
+            return 1;
+        }
+        cv::Size lineStartsFrameSize = lineStartsReader->getFrameSize();
+        if (lineStartsFrameSize != frameSize) {
+            cerr << "ERROR: The line-starts file is for frames of " << lineStartsFrameSize.width << "x" << lineStartsFrameSize.height
+                 << ", but the input video has frames of " << frameSize.width << "x" << frameSize.height << "." << endl;
+            return 1;
+        }
+        int frame_count = videoCapture->get(CAP_PROP_FRAME_COUNT);
+        if (frame_count > 0 && static_cast<uint32_t>(frame_count) != lineStartsReader->getFrameCount()) {
+            cerr << "WARNING: The input video reports " << frame_count << " frames, but the line-starts file has "
+                 << lineStartsReader->getFrameCount() << "." << endl;
+        }
+    }
     VideoWriter *videoWriter = nullptr;
-    if (piping_to_stdout) {
-        videoWriter = new StdoutVideoWriter();
+    StdoutVideoWriter *stdoutVideoWriter = nullptr;
+    LineStartsWriter *lineStartsWriter = nullptr;
+    std::vector<VideoWriter *> sweepVideoWriters;
+    int copied_streams = 0;
+    if (analyze_only) {
+        uint32_t flags = store_raw_line_starts ? LINE_STARTS_FILE_RAW | LINE_STARTS_FILE_SEGMENT_SIZES : 0;
+        lineStartsWriter = new LineStartsWriter(output_file, frameSize, flags);
+        if (!lineStartsWriter->isOpened()) {
+            cerr << "ERROR: " << lineStartsWriter->getLastError() << endl;
+            return 1;
+        }
+    } else if (preview_image) {
+        // The preview grid is written as an image by write_preview_grid.
+    } else if (piping_to_stdout) {
+        stdoutVideoWriter = new StdoutVideoWriter(frame_format, y4m_output, fps);
+        videoWriter = stdoutVideoWriter;
 #ifdef _WIN32
         _setmode(_fileno(stdout), _O_BINARY);
 #endif
+    } else if (!sweep_sets.empty()) {
+        // One output video per parameter set, or none if only the statistics are wanted.
+        for (size_t i = 0; i < sweep_sets.size() && !output_file.empty(); ++i) {
+            VideoWriter *sweepVideoWriter =
+                create_video_writer(get_sweep_output_file(output_file, static_cast<int>(i) + 1), codec, encoder_options, encoder_threads,
+                                    fps, frameSize, frame_format, copy_streams ? input_file : "", copied_streams);
+            sweepVideoWriters.push_back(sweepVideoWriter);
+            if (!sweepVideoWriter->isOpened()) {
+                cerr << "Could not create video writer" << endl;
+                return 1;
+            }
+        }
     } else {
-        videoWriter = new VideoWriter(output_file, fourcc, fps, frameSize, isColor);
+        // The preview shows the input and the corrected frames side by side.
+        cv::Size outputFrameSize = preview_positions > 0 ? get_preview_frame_size(frameSize) : frameSize;
+        videoWriter = create_video_writer(output_file, codec, encoder_options, encoder_threads, fps, outputFrameSize, frame_format,
+                                          copy_streams ? input_file : "", copied_streams);
     }
-    if (!videoWriter->isOpened()) {
+    if (!analyze_only && sweep_sets.empty() && !preview_image && !videoWriter->isOpened()) {
         cerr << "Could not create video writer" << endl;
         return 1;
     }
 
     // Print summary of processing parameters.
     cout << "Processing parameters:" << endl;
-    if (framerate == -1) {
-        cout << "  Frame rate:                       " << fps << " (same as input)" << endl;
+    if (analyze_only) {
+        cout << "  Mode:                             analyze only" << (store_raw_line_starts ? " (with raw line starts)" : "") << endl;
     } else {
-        cout << "  Frame rate:                       " << fps << " (specified by user)" << endl;
+        if (lineStartsReader != nullptr) {
+            cout << "  Mode:                             apply shifts from " << apply_shifts_file << endl;
+        }
+        if (!sweep_sets.empty()) {
+            cout << "  Mode:                             sweep of " << sweep_sets.size() << " parameter sets from " << sweep_file
+                 << (sweep_statistics_only ? " (statistics only)" : "") << endl;
+        }
+        if (preview_positions > 0) {
+            cout << "  Mode:                             preview of " << preview_positions << " positions with " << DEFAULT_PREVIEW_BURST_FRAMES
+                 << " frames each" << (preview_image ? " (image grid)" : "") << endl;
+        }
+        if (sweep_statistics_only || preview_image) {
+            // No video is written.
+        } else if (framerate == -1) {
+            cout << "  Frame rate:                       " << fps << " (same as input)" << endl;
+        } else {
+            cout << "  Frame rate:                       " << fps << " (specified by user)" << endl;
+        }
     }
-    cout << "  Column range:                     " << parameters.colRange << endl;
+    cout << "  Column range:                     " << parameters.colRange << (auto_col_range ? " (estimated)" : "") << endl;
     cout << "  Target line start:                " << parameters.targetLineStart << endl;
     cout << "  Pure black width:                 " << parameters.pureBlackWidth << endl;
     cout << "  Pure black threshold:             " << parameters.pureBlackThreshold << endl;
     cout << "  Min line start segment length:    " << parameters.minLineStartSegmentLength << endl;
     cout << "  Line start smoothing kernel size: " << parameters.lineStartSmoothingKernelSize << endl;
+    cout << "  Pixel format:                     " << frame_format_name(frame_format) << endl;
+    cout << "  Scan method:                      " << scan_method << endl;
+    if (temporal_window > 0) {
+        cout << "  Temporal window:                  " << temporal_window << endl;
+    }
+    cout << "  Threads:                          " << num_threads << endl;
+    if (!piping_to_stdout && !analyze_only && !sweep_statistics_only && !preview_image) {
+        cout << "  Codec:                            " << codec << endl;
+        if (copy_streams) {
+            cout << "  Copied streams:                   " << copied_streams << endl;
+        }
+    }
 
     chrono::time_point<chrono::system_clock> start, end;
     start = chrono::system_clock::now();
+    set_profiling_enabled(!profile_file.empty());
 
+    ProcessingStatistics statistics;
+    std::vector<SweepStatistics> sweep_statistics;
     try {
-        process_single_threaded(videoCapture, *videoWriter, parameters, !piping_to_stdout);
+        if (!sweep_sets.empty()) {
+            statistics = process_sweep(*videoCapture, sweep_sets, sweepVideoWriters, !piping_to_stdout, sweep_statistics);
+        } else if (preview_image) {
+            statistics = write_preview_grid(*videoCapture, output_file, parameters, preview_positions);
+        } else if (preview_positions > 0) {
+            statistics = process_preview(*videoCapture, *videoWriter, parameters, preview_positions);
+        } else if (analyze_only) {
+            statistics = process_analyze_only(*videoCapture, *lineStartsWriter, parameters, !piping_to_stdout);
+        } else if (lineStartsReader != nullptr) {
+            statistics = process_apply_shifts(*videoCapture, *videoWriter, *lineStartsReader, parameters, !piping_to_stdout);
+        } else if (num_threads == 1) {
+            statistics = process_single_threaded(*videoCapture, *videoWriter, parameters, !piping_to_stdout, queue_depth, huge_pages);
+        } else {
+            statistics = process_multi_threaded(*videoCapture, *videoWriter, parameters, !piping_to_stdout, num_threads, huge_pages);
+        }
     } catch (const std::exception &e) {
         cerr << "ERROR: " << e.what() << endl;
         return 1;
     }
+    long bytes_written_to_stdout = 0;
+    int pipe_size = 0;
+    if (stdoutVideoWriter != nullptr) {
+        bytes_written_to_stdout = stdoutVideoWriter->getTotalWritten();
+        pipe_size = stdoutVideoWriter->getPipeSize();
+    }
+    if (lineStartsWriter != nullptr) {
+        bool completed = lineStartsWriter->close();
+        if (!completed) {
+            cerr << "ERROR: " << lineStartsWriter->getLastError() << endl;
+            return 1;
+        }
+        delete lineStartsWriter;
+        lineStartsWriter = nullptr;
+    }
+    delete lineStartsReader;
+    lineStartsReader = nullptr;
     delete videoWriter;
     videoWriter = nullptr;
+    for (VideoWriter *sweepVideoWriter : sweepVideoWriters) {
+        delete sweepVideoWriter;
+    }
+    sweepVideoWriters.clear();
+    delete videoCapture;
+    videoCapture = nullptr;
 
     end = chrono::system_clock::now();
+    bool profile_written = false;
+    if (!profile_file.empty()) {
+        profile_written = write_profile_report(profile_file);
+        if (!profile_written) {
+            cerr << "WARNING: The profile cannot be written to " << profile_file << "." << endl;
+        }
+    }
     long elapsed_milliseconds = chrono::duration_cast<chrono::milliseconds>(end - start).count();
     time_t start_time = chrono::system_clock::to_time_t(start);
     time_t end_time = chrono::system_clock::to_time_t(end);
@@ -260,6 +933,53 @@ int main(int argc, char *argv[]) {
     cout << "Started at  " << ctime(&start_time);
     cout << "Finished at " << ctime(&end_time);
     cout << "Elapsed time: " << elapsed_milliseconds << " milliseconds" << endl;
+    cout << (analyze_only ? "Frames analyzed: " : sweep_sets.empty() ? "Frames written: " : "Frames decoded: ") << statistics.framesWritten
+         << endl;
+    if (!sweep_sets.empty()) {
+        // Detection noise: mean distance of the detected edges from the final line starts (see SweepStatistics). Missing:
+        // rows without any line start. Merged: rows where the line start (left) or line end (right) won the merge.
+        cout << "Sweep results:" << endl;
+        cout << "  Set   Detection noise   Missing rows   Merged (starts/ends)   Parameters" << endl;
+        for (size_t i = 0; i < sweep_sets.size(); ++i) {
+            const SweepStatistics &set = sweep_statistics[i];
+            cout << "  " << std::setw(3) << i + 1 << "   " << std::fixed << std::setprecision(3) << std::setw(12) << set.getDetectionNoise()
+                 << " px   " << std::setw(11) << std::setprecision(2) << 100.0 * set.getMissingFraction() << "%   " << std::setw(20)
+                 << std::to_string(set.mergedFromStarts) + "/" + std::to_string(set.mergedFromEnds) << "   " << sweep_sets[i].description
+                 << endl;
+        }
+        cout << std::defaultfloat << std::setprecision(6);
+    }
+    if (statistics.readQueueCapacity > 0) {
+        // A full read queue means that the correction is the bottleneck, a full write queue means that the encoder is.
+        cout << "Queue high-water marks: read " << statistics.readQueueHighWaterMark << "/" << statistics.readQueueCapacity << ", write "
+             << statistics.writeQueueHighWaterMark << "/" << statistics.writeQueueCapacity << endl;
+    }
+    if (statistics.duplicateFrames > 0 && statistics.framesWritten > 0) {
+        cout << "Duplicate frames: " << statistics.duplicateFrames << " (" << 100.0 * statistics.duplicateFrames / statistics.framesWritten
+             << "%), line-start detection skipped" << endl;
+    }
+    if (statistics.temporalWindowRows > 0) {
+        cout << "Temporal window: " << 100.0 * (statistics.temporalWindowRows - statistics.temporalFallbackRows) / statistics.temporalWindowRows
+             << "% of the border searches found the edge in the window, prior reset " << statistics.temporalPriorResets << " times" << endl;
+    }
+    if (statistics.framePoolBytes > 0) {
+        cout << "Frame pool: " << statistics.framePoolSlots << " slots, " << statistics.framePoolBytes / (1024.0 * 1024.0) << " MiB"
+             << (statistics.framePoolHugePages ? " (huge pages)" : "") << endl;
+    }
+    if (profile_written) {
+        cout << "Profile written to " << profile_file << endl;
+    }
+
+    // When piping to stdout, the summary above is suppressed. The throughput of the pipe is reported on stderr.
+    if (piping_to_stdout) {
+        double megabytes = bytes_written_to_stdout / (1024.0 * 1024.0);
+        cerr << "Written to stdout: " << megabytes << " MB in " << elapsed_milliseconds << " milliseconds ("
+             << megabytes / std::max(elapsed_milliseconds, 1L) * 1000.0 << " MB/s";
+        if (pipe_size > 0) {
+            cerr << ", pipe buffer " << pipe_size / 1024 << " KiB";
+        }
+        cerr << ")" << endl;
+    }
 
     return 0;
 }
@@ -0,0 +1,43 @@
+#include "process_analyze_only.h"
+#include "Profiler.h"
+#include "correct_frame.h"
+
+#include <cassert>
+#include <iostream>
+#include <stdexcept>
+
+ProcessingStatistics process_analyze_only(cv::VideoCapture &videoCapture, LineStartsWriter &lineStartsWriter,
+                                          const ProcessingParameters &parameters, bool print_progress) {
+    int frame_count = videoCapture.get(cv::CAP_PROP_FRAME_COUNT);
+    ProcessingStatistics statistics;
+
+    DeshakeContext context;
+    context.keepRawLineStarts = (lineStartsWriter.getFlags() & LINE_STARTS_FILE_RAW) != 0;
+
+    // The frame is decoded into the same buffer each time.
+    cv::Mat img;
+    while (true) {
+        {
+            ProfileScope scope(PROFILE_STAGE_DECODE);
+            if (!videoCapture.grab() || !videoCapture.retrieve(img)) {
+                break;
+            }
+            assert(!img.empty());
+        }
+
+        analyze_frame(img, parameters, context);
+        statistics.temporalWindowRows += context.temporalWindowRows;
+        statistics.temporalFallbackRows += context.temporalFallbackRows;
+        statistics.temporalPriorResets += context.temporalPriorReset ? 1 : 0;
+        statistics.duplicateFrames += context.duplicateFrame ? 1 : 0;
+        if (!lineStartsWriter.write(context)) {
+            throw std::runtime_error(lineStartsWriter.getLastError());
+        }
+
+        if (print_progress && statistics.framesWritten >= 1000 && statistics.framesWritten % 1000 == 0) {
+            std::cout << "Current frame: " << statistics.framesWritten << "/" << frame_count << std::endl;
+        }
+        ++statistics.framesWritten;
+    }
+    return statistics;
+}
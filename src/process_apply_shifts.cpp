@@ -0,0 +1,52 @@
+#include "process_apply_shifts.h"
+#include "Profiler.h"
+#include "correct_frame.h"
+
+#include <cassert>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+ProcessingStatistics process_apply_shifts(cv::VideoCapture &videoCapture, cv::VideoWriter &videoWriter,
+                                          const LineStartsReader &lineStartsReader, const ProcessingParameters &parameters,
+                                          bool print_progress) {
+    int frame_count = videoCapture.get(cv::CAP_PROP_FRAME_COUNT);
+    const uint32_t line_starts_frame_count = lineStartsReader.getFrameCount();
+    ProcessingStatistics statistics;
+
+    // The buffers are reused for all frames.
+    cv::Mat img, corrected;
+    std::vector<int> line_starts;
+    while (true) {
+        {
+            ProfileScope scope(PROFILE_STAGE_DECODE);
+            if (!videoCapture.grab() || !videoCapture.retrieve(img)) {
+                break;
+            }
+            assert(!img.empty());
+        }
+        if (statistics.framesWritten >= line_starts_frame_count) {
+            throw std::runtime_error("The input video has more frames than the line-starts file (" +
+                                     std::to_string(line_starts_frame_count) + ")");
+        }
+
+        lineStartsReader.readLineStarts(static_cast<uint32_t>(statistics.framesWritten), line_starts);
+        shift_frame(img, line_starts, parameters, corrected);
+        {
+            ProfileScope scope(PROFILE_STAGE_ENCODE);
+            videoWriter.write(corrected);
+        }
+
+        if (print_progress && statistics.framesWritten >= 1000 && statistics.framesWritten % 1000 == 0) {
+            std::cout << "Current frame: " << statistics.framesWritten << "/" << frame_count << std::endl;
+        }
+        ++statistics.framesWritten;
+    }
+
+    if (statistics.framesWritten != line_starts_frame_count) {
+        throw std::runtime_error("The input video has fewer frames (" + std::to_string(statistics.framesWritten) +
+                                 ") than the line-starts file (" + std::to_string(line_starts_frame_count) + ")");
+    }
+    return statistics;
+}
@@ -0,0 +1,221 @@
+#include "process_multi_threaded.h"
+#include "BoundedQueue.h"
+#include "FramePool.h"
+#include "Profiler.h"
+#include "correct_frame.h"
+
+#include <condition_variable>
+#include <exception>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace {
+
+// A frame and the slot of the frame pool that holds its buffers.
+struct IndexedFrame {
+    int index = -1;
+    int slot = -1;
+};
+
+/**
+ * Shared state of the pipeline threads: limits the number of frames that are in flight (decoded but not yet written)
+ * and remembers the first error that occurred in any of the threads.
+ */
+class PipelineState {
+  public:
+    explicit PipelineState(int max_in_flight) : maxInFlight_(max_in_flight) {}
+
+    // Blocks until frame_index may be decoded. Returns false if the pipeline has failed.
+    bool waitForSlot(int frame_index) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        slotFree_.wait(lock, [&] { return error_ || frame_index - written_ < maxInFlight_; });
+        return !error_;
+    }
+
+    void frameWritten() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            ++written_;
+        }
+        slotFree_.notify_one();
+    }
+
+    void fail(std::exception_ptr error) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!error_) {
+                error_ = error;
+            }
+        }
+        slotFree_.notify_all();
+    }
+
+    bool failed() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return static_cast<bool>(error_);
+    }
+
+    void rethrowIfFailed() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (error_) {
+            std::rethrow_exception(error_);
+        }
+    }
+
+  private:
+    const int maxInFlight_;
+    int written_ = 0;
+    std::exception_ptr error_;
+    std::mutex mutex_;
+    std::condition_variable slotFree_;
+};
+
+} // namespace
+
+ProcessingStatistics process_multi_threaded(cv::VideoCapture &videoCapture, cv::VideoWriter &videoWriter,
+                                            const ProcessingParameters &parameters, bool print_progress, int num_threads,
+                                            bool huge_pages) {
+    if (num_threads < 1) {
+        throw std::invalid_argument("num_threads must be >= 1");
+    }
+    if (parameters.temporalSearchWindow > 0) {
+        // Each worker only sees some of the frames, so the line starts of the previous frame are unknown.
+        throw std::invalid_argument("temporalSearchWindow requires the frames to be processed in order (process_single_threaded)");
+    }
+    if (parameters.detectDuplicateFrames) {
+        // A worker would compare each frame with a frame num_threads frames earlier, not with the previous frame.
+        throw std::invalid_argument("detectDuplicateFrames requires the frames to be processed in order (process_single_threaded)");
+    }
+
+    int frame_count = videoCapture.get(cv::CAP_PROP_FRAME_COUNT);
+    const int queue_capacity = 2 * num_threads;
+
+    BoundedQueue<IndexedFrame> decodedFrames(queue_capacity);
+    BoundedQueue<IndexedFrame> correctedFrames(queue_capacity);
+    const int max_in_flight = 4 * num_threads;
+    PipelineState state(max_in_flight);
+    ProcessingStatistics statistics;
+
+    // PipelineState already limits the number of frames in flight, so the decoder never has to wait for a slot.
+    const cv::Size frame_size(videoCapture.get(cv::CAP_PROP_FRAME_WIDTH), videoCapture.get(cv::CAP_PROP_FRAME_HEIGHT));
+    FramePool pool(max_in_flight, frame_size, static_cast<FrameFormat>(parameters.frameFormat), huge_pages);
+    statistics.framePoolSlots = pool.slotCount();
+    statistics.framePoolBytes = pool.allocatedBytes();
+    statistics.framePoolHugePages = pool.usesHugePages();
+
+    // Closing both queues wakes up all threads that are blocked in push() or pop().
+    auto abort = [&](std::exception_ptr error) {
+        state.fail(error);
+        decodedFrames.close();
+        correctedFrames.close();
+        pool.close();
+    };
+
+    std::thread decoder([&] {
+        try {
+            int i = 0;
+            while (state.waitForSlot(i)) {
+                // Each frame in flight has its own pool slot because it is handed over to other threads.
+                IndexedFrame item;
+                item.index = i;
+                item.slot = pool.acquire();
+                if (item.slot < 0) {
+                    break;
+                }
+                {
+                    ProfileScope scope(PROFILE_STAGE_DECODE);
+                    if (!videoCapture.grab() || !videoCapture.retrieve(pool.input(item.slot))) {
+                        pool.release(item.slot);
+                        break;
+                    }
+                    assert(!pool.input(item.slot).empty());
+                }
+
+                if (!decodedFrames.push(std::move(item))) {
+                    break;
+                }
+                ++i;
+            }
+        } catch (...) {
+            abort(std::current_exception());
+        }
+        decodedFrames.close();
+    });
+
+    std::vector<std::thread> workers;
+    for (int t = 0; t < num_threads; ++t) {
+        workers.emplace_back([&] {
+            try {
+                DeshakeContext context;
+
+                IndexedFrame item;
+                while (decodedFrames.pop(item)) {
+                    if (state.failed()) {
+                        break;
+                    }
+
+                    correct_frame(pool.input(item.slot), parameters, context, pool.output(item.slot));
+
+                    if (!correctedFrames.push(item)) {
+                        break;
+                    }
+                }
+            } catch (...) {
+                abort(std::current_exception());
+            }
+        });
+    }
+
+    std::thread writer([&] {
+        try {
+            // Frames can be finished out of order by the workers. They are kept here until it is their turn.
+            std::map<int, int> reorderBuffer; // frame index -> slot
+            int next_index = 0;
+
+            IndexedFrame item;
+            while (correctedFrames.pop(item)) {
+                if (state.failed()) {
+                    break;
+                }
+
+                reorderBuffer[item.index] = item.slot;
+                for (auto it = reorderBuffer.find(next_index); it != reorderBuffer.end(); it = reorderBuffer.find(next_index)) {
+                    {
+                        ProfileScope scope(PROFILE_STAGE_ENCODE);
+                        videoWriter.write(pool.output(it->second));
+                    }
+                    pool.release(it->second);
+                    reorderBuffer.erase(it);
+                    state.frameWritten();
+                    ++statistics.framesWritten;
+
+                    if (print_progress && next_index >= 1000 && next_index % 1000 == 0) {
+                        std::cout << "Current frame: " << next_index << "/" << frame_count << std::endl;
+                    }
+                    ++next_index;
+                }
+            }
+            assert(state.failed() || reorderBuffer.empty());
+        } catch (...) {
+            abort(std::current_exception());
+        }
+    });
+
+    decoder.join();
+    for (auto &worker : workers) {
+        worker.join();
+    }
+    correctedFrames.close();
+    writer.join();
+
+    state.rethrowIfFailed();
+
+    statistics.readQueueCapacity = decodedFrames.capacity();
+    statistics.readQueueHighWaterMark = decodedFrames.highWaterMark();
+    statistics.writeQueueCapacity = correctedFrames.capacity();
+    statistics.writeQueueHighWaterMark = correctedFrames.highWaterMark();
+    return statistics;
+}
@@ -0,0 +1,169 @@
+#include "process_preview.h"
+#include "correct_frame.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <functional>
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/imgproc.hpp>
+#include <stdexcept>
+#include <vector>
+
+namespace {
+
+// Called for each corrected frame with the index of the position, the frame number, the input and the corrected frame.
+using PreviewFrameHandler = std::function<void(int, long, const cv::Mat &, const cv::Mat &)>;
+
+/**
+ * Seeks to the positions and corrects a burst of frames at each of them (see process_preview).
+ */
+void correct_preview_frames(cv::VideoCapture &videoCapture, const ProcessingParameters &parameters, int positions, int burst_frames,
+                            const PreviewFrameHandler &handler, ProcessingStatistics &statistics) {
+    if (positions < 1) {
+        throw std::invalid_argument("positions must be >= 1");
+    }
+    if (burst_frames < 1) {
+        throw std::invalid_argument("burst_frames must be >= 1");
+    }
+    const long frame_count = static_cast<long>(videoCapture.get(cv::CAP_PROP_FRAME_COUNT));
+    if (frame_count <= 0) {
+        throw std::runtime_error("The number of frames of the input video is unknown");
+    }
+
+    cv::Mat img, out;
+    for (int i = 0; i < positions; ++i) {
+        // The bursts are centered on the positions, but do not extend beyond the start or the end of the video.
+        long first = static_cast<long>((i + 0.5) * frame_count / positions) - burst_frames / 2;
+        first = std::max(0L, std::min(first, frame_count - burst_frames));
+        if (!videoCapture.set(cv::CAP_PROP_POS_FRAMES, static_cast<double>(first))) {
+            throw std::runtime_error("The input video does not support seeking");
+        }
+
+        DeshakeContext context;
+        for (int k = 0; k < burst_frames; ++k) {
+            // The frame count may be an estimate, i.e. the last frames may not exist.
+            if (!videoCapture.grab() || !videoCapture.retrieve(img)) {
+                break;
+            }
+            correct_frame(img, parameters, context, out);
+            statistics.duplicateFrames += context.duplicateFrame ? 1 : 0;
+            handler(i, first + k, img, out);
+            ++statistics.framesWritten;
+        }
+    }
+}
+
+/**
+ * Copies the input frame and the corrected frame side by side into preview (plane by plane for planar YUV frames).
+ */
+void compose_side_by_side(const cv::Mat &input, const cv::Mat &output, FrameFormat format, cv::Mat &preview) {
+    const cv::Size frameSize = get_frame_size(input, format);
+    create_frame_buffer(preview, get_preview_frame_size(frameSize), format);
+    if (!is_planar_yuv(format)) {
+        input.copyTo(preview.colRange(0, frameSize.width));
+        output.copyTo(preview.colRange(frameSize.width, 2 * frameSize.width));
+        return;
+    }
+    for (int plane = 0; plane < 3; ++plane) {
+        const cv::Mat input_plane = get_plane(input, format, plane);
+        cv::Mat preview_plane = get_plane(preview, format, plane);
+        input_plane.copyTo(preview_plane.colRange(0, input_plane.cols));
+        get_plane(output, format, plane).copyTo(preview_plane.colRange(input_plane.cols, 2 * input_plane.cols));
+    }
+}
+
+/**
+ * Converts a frame to BGR. OpenCV only converts planar YUV 4:2:0, so for 4:2:2 every second chroma row is dropped,
+ * which is good enough for a preview.
+ */
+void convert_to_bgr(const cv::Mat &frame, FrameFormat format, cv::Mat &bgr) {
+    if (!is_planar_yuv(format)) {
+        frame.copyTo(bgr);
+        return;
+    }
+    cv::Mat i420 = frame;
+    if (format != FRAME_FORMAT_YUV420P) {
+        i420 = cv::Mat();
+        create_frame_buffer(i420, get_frame_size(frame, format), FRAME_FORMAT_YUV420P);
+        get_plane(frame, format, 0).copyTo(get_plane(i420, FRAME_FORMAT_YUV420P, 0));
+        for (int plane = 1; plane < 3; ++plane) {
+            cv::Mat chroma = get_plane(i420, FRAME_FORMAT_YUV420P, plane);
+            cv::resize(get_plane(frame, format, plane), chroma, chroma.size(), 0, 0, cv::INTER_NEAREST);
+        }
+    }
+    cv::cvtColor(i420, bgr, cv::COLOR_YUV2BGR_I420);
+}
+
+} // namespace
+
+cv::Size get_preview_frame_size(const cv::Size &frameSize) { return cv::Size(2 * frameSize.width, frameSize.height); }
+
+bool is_preview_image_file(const std::string &filename) {
+    const size_t dot = filename.find_last_of('.');
+    if (dot == std::string::npos) {
+        return false;
+    }
+    std::string extension = filename.substr(dot + 1);
+    std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return std::tolower(c); });
+    return extension == "png" || extension == "jpg" || extension == "jpeg" || extension == "bmp" || extension == "tif" ||
+           extension == "tiff";
+}
+
+ProcessingStatistics process_preview(cv::VideoCapture &videoCapture, cv::VideoWriter &videoWriter, const ProcessingParameters &parameters,
+                                     int positions, int burst_frames) {
+    ProcessingStatistics statistics;
+    const FrameFormat format = static_cast<FrameFormat>(parameters.frameFormat);
+
+    cv::Mat preview;
+    correct_preview_frames(
+        videoCapture, parameters, positions, burst_frames,
+        [&](int, long, const cv::Mat &input, const cv::Mat &output) {
+            compose_side_by_side(input, output, format, preview);
+            videoWriter.write(preview);
+        },
+        statistics);
+    return statistics;
+}
+
+ProcessingStatistics write_preview_grid(cv::VideoCapture &videoCapture, const std::string &image_file, const ProcessingParameters &parameters,
+                                        int positions, int burst_frames) {
+    ProcessingStatistics statistics;
+    const FrameFormat format = static_cast<FrameFormat>(parameters.frameFormat);
+
+    // The last corrected frame of each burst is kept (a burst may be shorter at the end of the video).
+    std::vector<cv::Mat> cells(positions);
+    std::vector<long> frame_numbers(positions, -1);
+    correct_preview_frames(
+        videoCapture, parameters, positions, burst_frames,
+        [&](int position, long frame, const cv::Mat &input, const cv::Mat &output) {
+            compose_side_by_side(input, output, format, cells[position]);
+            frame_numbers[position] = frame;
+        },
+        statistics);
+    if (statistics.framesWritten == 0) {
+        throw std::runtime_error("No frames could be read from the input video");
+    }
+
+    // Each cell is about twice as wide as high, so the grid has about twice as many rows as columns to be roughly square.
+    const cv::Size cell_size = get_preview_frame_size(
+        cv::Size(static_cast<int>(videoCapture.get(cv::CAP_PROP_FRAME_WIDTH)), static_cast<int>(videoCapture.get(cv::CAP_PROP_FRAME_HEIGHT))));
+    const int columns = std::max(1, static_cast<int>(std::ceil(std::sqrt(positions / 2.0))));
+    const int rows = (positions + columns - 1) / columns;
+    cv::Mat grid(rows * cell_size.height, columns * cell_size.width, CV_8UC3, cv::Scalar(0, 0, 0));
+    cv::Mat bgr;
+    for (int i = 0; i < positions; ++i) {
+        if (frame_numbers[i] == -1) {
+            continue;
+        }
+        const cv::Rect cell((i % columns) * cell_size.width, (i / columns) * cell_size.height, cell_size.width, cell_size.height);
+        convert_to_bgr(cells[i], format, bgr);
+        bgr.copyTo(grid(cell));
+        cv::putText(grid, "frame " + std::to_string(frame_numbers[i]), cv::Point(cell.x + 8, cell.y + 24), cv::FONT_HERSHEY_SIMPLEX,
+                    0.7, cv::Scalar(255, 255, 255), 2);
+    }
+    if (!cv::imwrite(image_file, grid)) {
+        throw std::runtime_error("The preview image " + image_file + " cannot be written");
+    }
+    return statistics;
+}
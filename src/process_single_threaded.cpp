@@ -1,8 +1,13 @@
 #include "process_single_threaded.h"
+#include "BoundedQueue.h"
+#include "FramePool.h"
+#include "Profiler.h"
 #include "correct_frame.h"
 
+#include <exception>
 #include <iostream>
 #include <opencv2/highgui.hpp>
+#include <thread>
 #include <vector>
 
 // #define ENABLE_DEBUGGING
@@ -12,45 +17,167 @@
 #include <opencv2/imgproc.hpp>
 #endif
 
-void process_single_threaded(cv::VideoCapture &videoCapture, cv::VideoWriter &videoWriter, const ProcessingParameters &parameters,
-                             bool print_progress) {
-    int i = 0;
+ProcessingStatistics process_single_threaded(cv::VideoCapture &videoCapture, cv::VideoWriter &videoWriter,
+                                             const ProcessingParameters &parameters, bool print_progress, int queue_depth,
+                                             bool huge_pages) {
+    if (queue_depth < 0) {
+        throw std::invalid_argument("queue_depth must be >= 0");
+    }
+
     int frame_count = videoCapture.get(cv::CAP_PROP_FRAME_COUNT);
-    cv::Mat img, corrected, grayBuffer1, grayBuffer2;
-    std::vector<int> line_starts, line_ends;
-    while (videoCapture.grab()) {
-        bool ret = videoCapture.retrieve(img);
-        assert(ret);
-        assert(!img.empty());
+    ProcessingStatistics statistics;
+    const bool use_queues = queue_depth > 0;
+
+    // Frames in flight: up to queue_depth in each queue, plus one in each of the reader, the correction and the writer.
+    const int pool_size = use_queues ? 2 * queue_depth + 3 : 1;
+    const cv::Size frame_size(videoCapture.get(cv::CAP_PROP_FRAME_WIDTH), videoCapture.get(cv::CAP_PROP_FRAME_HEIGHT));
+    FramePool pool(pool_size, frame_size, static_cast<FrameFormat>(parameters.frameFormat), huge_pages);
+    statistics.framePoolSlots = pool.slotCount();
+    statistics.framePoolBytes = pool.allocatedBytes();
+    statistics.framePoolHugePages = pool.usesHugePages();
+
+    // Decodes the next frame into the input buffer of the slot.
+    auto read_frame = [&](int slot) {
+        ProfileScope scope(PROFILE_STAGE_DECODE);
+        // retrieve() fails if the input ends within the frame (see StdinVideoReader).
+        if (!videoCapture.grab() || !videoCapture.retrieve(pool.input(slot))) {
+            return false;
+        }
+        assert(!pool.input(slot).empty());
+        return true;
+    };
+
+    auto write_frame = [&](int slot) {
+        {
+            ProfileScope scope(PROFILE_STAGE_ENCODE);
+            videoWriter.write(pool.output(slot));
+        }
+        if (print_progress && statistics.framesWritten >= 1000 && statistics.framesWritten % 1000 == 0) {
+            std::cout << "Current frame: " << statistics.framesWritten << "/" << frame_count << std::endl;
+        }
+        ++statistics.framesWritten;
+    };
+
+    // Read-ahead and write-behind stages (only if use_queues). The slots of the frame pool are passed through the
+    // queues. Each thread closes its queue when it stops, which also stops the other stages.
+    BoundedQueue<int> decodedFrames(queue_depth);
+    BoundedQueue<int> correctedFrames(queue_depth);
+    std::exception_ptr reader_error, writer_error;
+    std::thread reader, writer;
+    if (use_queues) {
+        reader = std::thread([&] {
+            try {
+                for (int slot = pool.acquire(); slot >= 0; slot = pool.acquire()) {
+                    if (!read_frame(slot)) {
+                        pool.release(slot);
+                        break;
+                    }
+                    if (!decodedFrames.push(slot)) {
+                        break;
+                    }
+                }
+            } catch (...) {
+                reader_error = std::current_exception();
+            }
+            decodedFrames.close();
+        });
+        writer = std::thread([&] {
+            try {
+                int slot;
+                while (correctedFrames.pop(slot)) {
+                    write_frame(slot);
+                    pool.release(slot);
+                }
+            } catch (...) {
+                writer_error = std::current_exception();
+            }
+            correctedFrames.close();
+        });
+    }
+
+    auto next_frame = [&](int &slot) {
+        if (use_queues) {
+            return decodedFrames.pop(slot);
+        }
+        slot = 0;
+        return read_frame(slot);
+    };
+
+    auto stop_threads = [&] {
+        decodedFrames.close();
+        correctedFrames.close();
+        pool.close();
+        reader.join();
+        writer.join();
+    };
+
+    int i = 0;
+    int slot;
+    DeshakeContext context;
+    try {
+        while (next_frame(slot)) {
+            cv::Mat &img = pool.input(slot);
+            cv::Mat &corrected = pool.output(slot);
 
 #ifdef ENABLE_DEBUGGING
-        if (i > 10) {
+            if (i > 10) {
 #endif
 
 #ifdef ENABLE_DRAW_FRAME_NUMBER
-            cv::putText(img, std::to_string(i), cv::Point(img.cols / 2, 200), cv::FONT_HERSHEY_SIMPLEX, 5, cv::Scalar(255, 255, 255), 3,
-                        cv::LINE_AA);
+                cv::putText(img, std::to_string(i), cv::Point(img.cols / 2, 200), cv::FONT_HERSHEY_SIMPLEX, 5, cv::Scalar(255, 255, 255),
+                            3, cv::LINE_AA);
 #endif
-            correct_frame(img, parameters, grayBuffer1, grayBuffer2, line_starts, line_ends, corrected);
+                correct_frame(img, parameters, context, corrected);
+                statistics.temporalWindowRows += context.temporalWindowRows;
+                statistics.temporalFallbackRows += context.temporalFallbackRows;
+                statistics.temporalPriorResets += context.temporalPriorReset ? 1 : 0;
+                statistics.duplicateFrames += context.duplicateFrame ? 1 : 0;
 
 #ifdef ENABLE_DEBUGGING
-            cv::namedWindow("Input");
-            cv::imshow("Input", img);
+                cv::namedWindow("Input");
+                cv::imshow("Input", img);
 
-            cv::namedWindow("Output");
-            cv::imshow("Output", corrected);
+                cv::namedWindow("Output");
+                cv::imshow("Output", corrected);
 #endif
 
-            videoWriter.write(corrected);
-            if (print_progress && i >= 1000 && i % 1000 == 0) {
-                std::cout << "Current frame: " << i << "/" << frame_count << std::endl;
-            }
+                if (!use_queues) {
+                    write_frame(slot);
+                } else if (!correctedFrames.push(slot)) {
+                    // The writer has failed.
+                    break;
+                }
 
 #ifdef ENABLE_DEBUGGING
-            cv::waitKey();
-        }
+                cv::waitKey();
+            } else if (use_queues) {
+                pool.release(slot);
+            }
 #endif
 
-        ++i;
+            ++i;
+        }
+    } catch (...) {
+        if (use_queues) {
+            stop_threads();
+        }
+        throw;
+    }
+
+    if (use_queues) {
+        // Stop the reader if the loop has been left early, and let the writer write the remaining frames.
+        stop_threads();
+        if (reader_error) {
+            std::rethrow_exception(reader_error);
+        }
+        if (writer_error) {
+            std::rethrow_exception(writer_error);
+        }
+
+        statistics.readQueueCapacity = decodedFrames.capacity();
+        statistics.readQueueHighWaterMark = decodedFrames.highWaterMark();
+        statistics.writeQueueCapacity = correctedFrames.capacity();
+        statistics.writeQueueHighWaterMark = correctedFrames.highWaterMark();
     }
+    return statistics;
 }
@@ -0,0 +1,257 @@
+#include "process_sweep.h"
+#include "Profiler.h"
+#include "correct_frame.h"
+#include "correct_frame_internal.h"
+
+#include <cassert>
+#include <climits>
+#include <cstdlib>
+#include <exception>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+
+using std::string;
+using std::vector;
+
+namespace {
+
+[[noreturn]] void fail(const string &filename, int line_number, const string &message) {
+    throw std::runtime_error(filename + ":" + std::to_string(line_number) + ": " + message);
+}
+
+bool parse_int(const string &value, int &result) {
+    char *end = nullptr;
+    long parsed = strtol(value.c_str(), &end, 10);
+    if (value.empty() || *end != '\0' || parsed < INT_MIN || parsed > INT_MAX) {
+        return false;
+    }
+    result = static_cast<int>(parsed);
+    return true;
+}
+
+/**
+ * Adds the line starts of the last frame analyzed with context to the statistics of its parameter set.
+ */
+void add_frame_statistics(const DeshakeContext &context, SweepStatistics &statistics) {
+    const vector<int> &line_starts = context.lineStarts;
+    for (size_t y = 0; y < line_starts.size(); ++y) {
+        const int raw_start = context.rawLineStarts[y];
+        const int raw_end = context.rawLineEnds[y];
+        if (raw_start == MISSING && raw_end == MISSING) {
+            ++statistics.missingRows;
+        }
+        if (line_starts[y] == MISSING) {
+            continue;
+        }
+        if (raw_start != MISSING) {
+            statistics.detectionNoiseSum += std::abs(raw_start - line_starts[y]);
+            ++statistics.detectionNoiseCount;
+        }
+        if (raw_end != MISSING) {
+            statistics.detectionNoiseSum += std::abs(raw_end - line_starts[y]);
+            ++statistics.detectionNoiseCount;
+        }
+    }
+    statistics.rows += static_cast<long>(line_starts.size());
+    statistics.mergedFromStarts += context.mergedFromStartsCount;
+    statistics.mergedFromEnds += context.mergedFromEndsCount;
+    statistics.duplicateFrames += context.duplicateFrame ? 1 : 0;
+    ++statistics.frames;
+}
+
+/**
+ * Corrects (or only analyzes) a frame with a range of the parameter sets. Exceptions are stored per set, because they
+ * must not escape cv::parallel_for_.
+ */
+class SweepCorrector : public cv::ParallelLoopBody {
+  public:
+    SweepCorrector(const cv::Mat &input, const vector<SweepSet> &sets, bool shift, vector<DeshakeContext> &contexts,
+                   vector<cv::Mat> &outputs, vector<SweepStatistics> &statistics, vector<std::exception_ptr> &errors)
+        : input_(input), sets_(sets), shift_(shift), contexts_(contexts), outputs_(outputs), statistics_(statistics), errors_(errors) {}
+
+    void operator()(const cv::Range &range) const override {
+        for (int i = range.start; i < range.end; ++i) {
+            try {
+                if (shift_) {
+                    correct_frame(input_, sets_[i].parameters, contexts_[i], outputs_[i]);
+                } else {
+                    analyze_frame(input_, sets_[i].parameters, contexts_[i]);
+                }
+                add_frame_statistics(contexts_[i], statistics_[i]);
+            } catch (...) {
+                errors_[i] = std::current_exception();
+            }
+        }
+    }
+
+  private:
+    const cv::Mat &input_;
+    const vector<SweepSet> &sets_;
+    const bool shift_;
+    vector<DeshakeContext> &contexts_;
+    vector<cv::Mat> &outputs_;
+    vector<SweepStatistics> &statistics_;
+    vector<std::exception_ptr> &errors_;
+};
+
+} // namespace
+
+vector<SweepSet> read_sweep_file(const string &filename, const ProcessingParameters &defaults) {
+    std::ifstream file(filename);
+    if (!file) {
+        throw std::runtime_error("Sweep file " + filename + " cannot be opened");
+    }
+
+    vector<SweepSet> sets;
+    string line;
+    int line_number = 0;
+    while (std::getline(file, line)) {
+        ++line_number;
+        const size_t begin = line.find_first_not_of(" \t\r");
+        if (begin == string::npos || line[begin] == '#') {
+            continue;
+        }
+        const size_t end = line.find_last_not_of(" \t\r");
+
+        SweepSet set;
+        set.description = line.substr(begin, end - begin + 1);
+        ProcessingParameters &parameters = set.parameters;
+        parameters = defaults;
+
+        std::istringstream tokens(set.description);
+        string token;
+        while (tokens >> token) {
+            const size_t separator = token.find('=');
+            if (separator == string::npos) {
+                fail(filename, line_number, "expected key=value instead of " + token);
+            }
+            const string key = token.substr(0, separator);
+            const string value = token.substr(separator + 1);
+
+            if (key == "scan-method") {
+                if (value == "fused") {
+                    parameters.scanMethod = ProcessingParameters::SCAN_METHOD_FUSED;
+                } else if (value == "gray") {
+                    parameters.scanMethod = ProcessingParameters::SCAN_METHOD_GRAY;
+                } else {
+                    fail(filename, line_number, "invalid scan method " + value + " (must be fused or gray)");
+                }
+                continue;
+            }
+
+            int number;
+            if (!parse_int(value, number)) {
+                fail(filename, line_number, "invalid value of " + key + " (must be an integer)");
+            }
+            if (key == "colrange") {
+                parameters.colRange = number;
+            } else if (key == "target-line-start") {
+                parameters.targetLineStart = number;
+            } else if (key == "pure-black-width") {
+                parameters.pureBlackWidth = number;
+            } else if (key == "pure-black-threshold") {
+                parameters.pureBlackThreshold = number;
+            } else if (key == "min-line-start-segment-length") {
+                parameters.minLineStartSegmentLength = number;
+            } else if (key == "line-start-smoothing-kernel-size") {
+                // Even kernel sizes are made odd, like on the commandline.
+                parameters.lineStartSmoothingKernelSize = number | 0x1;
+            } else if (key == "temporal-window") {
+                parameters.temporalSearchWindow = number;
+            } else {
+                fail(filename, line_number, "unknown parameter " + key);
+            }
+        }
+
+        // The same checks as for the commandline options. The checks that depend on the frame size are done by
+        // correct_frame.
+        if (parameters.pureBlackThreshold < 1 || parameters.pureBlackThreshold > 254) {
+            fail(filename, line_number, "invalid pure black threshold (must be in the range 1-254)");
+        }
+        if (parameters.temporalSearchWindow < 0) {
+            fail(filename, line_number, "invalid temporal window (must be 0 or a positive number)");
+        }
+        if (parameters.colRange == ProcessingParameters::DEFAULT_COL_RANGE) {
+            parameters.colRange = 2 * parameters.pureBlackWidth;
+        }
+        if (parameters.targetLineStart == ProcessingParameters::DEFAULT_TARGET_LINE_START) {
+            parameters.targetLineStart = parameters.pureBlackWidth;
+        }
+        sets.push_back(set);
+    }
+    if (file.bad()) {
+        throw std::runtime_error("Sweep file " + filename + " cannot be read");
+    }
+    if (sets.empty()) {
+        throw std::runtime_error("Sweep file " + filename + " contains no parameter sets");
+    }
+    return sets;
+}
+
+string get_sweep_output_file(const string &output_file, int index) {
+    // Only a dot after the last path separator starts the extension.
+    const size_t dot = output_file.find_last_of('.');
+    const size_t separator = output_file.find_last_of("/\\");
+    if (dot == string::npos || (separator != string::npos && dot < separator)) {
+        return output_file + "." + std::to_string(index);
+    }
+    return output_file.substr(0, dot) + "." + std::to_string(index) + output_file.substr(dot);
+}
+
+ProcessingStatistics process_sweep(cv::VideoCapture &videoCapture, const vector<SweepSet> &sets, const vector<cv::VideoWriter *> &videoWriters,
+                                   bool print_progress, vector<SweepStatistics> &set_statistics) {
+    if (sets.empty()) {
+        throw std::invalid_argument("sets must not be empty");
+    }
+    if (!videoWriters.empty() && videoWriters.size() != sets.size()) {
+        throw std::invalid_argument("videoWriters must be empty or have one writer per parameter set");
+    }
+
+    int frame_count = videoCapture.get(cv::CAP_PROP_FRAME_COUNT);
+    ProcessingStatistics statistics;
+    const bool shift = !videoWriters.empty();
+
+    // The raw line starts are needed for the detection noise.
+    vector<DeshakeContext> contexts(sets.size());
+    for (DeshakeContext &context : contexts) {
+        context.keepRawLineStarts = true;
+    }
+    vector<cv::Mat> outputs(sets.size());
+    vector<std::exception_ptr> errors(sets.size());
+    set_statistics.assign(sets.size(), SweepStatistics());
+
+    // The frame is decoded into the same buffer each time.
+    cv::Mat img;
+    while (true) {
+        {
+            ProfileScope scope(PROFILE_STAGE_DECODE);
+            if (!videoCapture.grab() || !videoCapture.retrieve(img)) {
+                break;
+            }
+            assert(!img.empty());
+        }
+
+        cv::parallel_for_(cv::Range(0, static_cast<int>(sets.size())),
+                          SweepCorrector(img, sets, shift, contexts, outputs, set_statistics, errors));
+        for (size_t i = 0; i < sets.size(); ++i) {
+            if (errors[i]) {
+                std::rethrow_exception(errors[i]);
+            }
+        }
+        if (shift) {
+            for (size_t i = 0; i < sets.size(); ++i) {
+                ProfileScope scope(PROFILE_STAGE_ENCODE);
+                videoWriters[i]->write(outputs[i]);
+            }
+        }
+
+        if (print_progress && statistics.framesWritten >= 1000 && statistics.framesWritten % 1000 == 0) {
+            std::cout << "Current frame: " << statistics.framesWritten << "/" << frame_count << std::endl;
+        }
+        ++statistics.framesWritten;
+    }
+
+    return statistics;
+}
@@ -0,0 +1,226 @@
+#include "scan_kernels.h"
+#include <cassert>
+#include <opencv2/core.hpp>
+
+// SSE2 is part of the x86-64 baseline, so only AVX2 has to be enabled per function (see TARGET_AVX2).
+#if defined(__x86_64__) || defined(_M_X64)
+#define SCAN_KERNELS_X86
+#include <immintrin.h>
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// GCC and Clang only emit AVX2 instructions for functions that are explicitly marked. MSVC does not need this.
+#if defined(__GNUC__) || defined(__clang__)
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define TARGET_AVX2
+#endif
+
+namespace {
+
+// Index of the lowest set bit. mask must not be 0.
+inline int lowest_bit(uint32_t mask) {
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return static_cast<int>(index);
+#else
+    return __builtin_ctz(mask);
+#endif
+}
+
+// Index of the highest set bit. mask must not be 0.
+inline int highest_bit(uint32_t mask) {
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanReverse(&index, mask);
+    return static_cast<int>(index);
+#else
+    return 31 - __builtin_clz(mask);
+#endif
+}
+
+int find_first_scalar(const uint8_t *row, int length, uint8_t threshold) {
+    for (int x = 0; x < length; ++x) {
+        if (row[x] > threshold) {
+            return x;
+        }
+    }
+    return -1;
+}
+
+int find_last_scalar(const uint8_t *row, int length, uint8_t threshold) {
+    for (int x = length - 1; x >= 0; --x) {
+        if (row[x] > threshold) {
+            return x;
+        }
+    }
+    return -1;
+}
+
+uint32_t column_mask_scalar(const uint8_t *column, uint8_t threshold) {
+    uint32_t mask = 0;
+    for (int r = 0; r < TRANSPOSED_TILE_ROWS; ++r) {
+        if (column[r] > threshold) {
+            mask |= 1u << r;
+        }
+    }
+    return mask;
+}
+
+#ifdef SCAN_KERNELS_X86
+// There is no unsigned byte comparison in SSE2/AVX2. Instead, the saturating subtraction pixel - threshold is
+// non-zero exactly for the pixels above the threshold. The returned bit mask has one bit per such pixel.
+inline uint32_t above_threshold_mask_sse2(const uint8_t *data, __m128i threshold) {
+    __m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data));
+    __m128i not_above = _mm_cmpeq_epi8(_mm_subs_epu8(pixels, threshold), _mm_setzero_si128());
+    return ~static_cast<uint32_t>(_mm_movemask_epi8(not_above)) & 0xFFFFu;
+}
+
+int find_first_sse2(const uint8_t *row, int length, uint8_t threshold) {
+    const __m128i t = _mm_set1_epi8(static_cast<char>(threshold));
+    int x = 0;
+    for (; x + 16 <= length; x += 16) {
+        uint32_t mask = above_threshold_mask_sse2(row + x, t);
+        if (mask != 0) {
+            return x + lowest_bit(mask);
+        }
+    }
+
+    int rest = find_first_scalar(row + x, length - x, threshold);
+    return rest == -1 ? -1 : x + rest;
+}
+
+int find_last_sse2(const uint8_t *row, int length, uint8_t threshold) {
+    const __m128i t = _mm_set1_epi8(static_cast<char>(threshold));
+    int x = length;
+    for (; x >= 16; x -= 16) {
+        uint32_t mask = above_threshold_mask_sse2(row + x - 16, t);
+        if (mask != 0) {
+            return x - 16 + highest_bit(mask);
+        }
+    }
+
+    return find_last_scalar(row, x, threshold);
+}
+
+uint32_t column_mask_sse2(const uint8_t *column, uint8_t threshold) {
+    const __m128i t = _mm_set1_epi8(static_cast<char>(threshold));
+    return above_threshold_mask_sse2(column, t) | (above_threshold_mask_sse2(column + 16, t) << 16);
+}
+
+TARGET_AVX2 inline uint32_t above_threshold_mask_avx2(const uint8_t *data, __m256i threshold) {
+    __m256i pixels = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data));
+    __m256i not_above = _mm256_cmpeq_epi8(_mm256_subs_epu8(pixels, threshold), _mm256_setzero_si256());
+    return ~static_cast<uint32_t>(_mm256_movemask_epi8(not_above));
+}
+
+// The AVX2 kernels process 32 pixels at a time and leave the remaining (less than 32) pixels to the SSE2 kernels.
+TARGET_AVX2 int find_first_avx2(const uint8_t *row, int length, uint8_t threshold) {
+    const __m256i t = _mm256_set1_epi8(static_cast<char>(threshold));
+    int x = 0;
+    for (; x + 32 <= length; x += 32) {
+        uint32_t mask = above_threshold_mask_avx2(row + x, t);
+        if (mask != 0) {
+            return x + lowest_bit(mask);
+        }
+    }
+
+    int rest = find_first_sse2(row + x, length - x, threshold);
+    return rest == -1 ? -1 : x + rest;
+}
+
+TARGET_AVX2 int find_last_avx2(const uint8_t *row, int length, uint8_t threshold) {
+    const __m256i t = _mm256_set1_epi8(static_cast<char>(threshold));
+    int x = length;
+    for (; x >= 32; x -= 32) {
+        uint32_t mask = above_threshold_mask_avx2(row + x - 32, t);
+        if (mask != 0) {
+            return x - 32 + highest_bit(mask);
+        }
+    }
+
+    return find_last_sse2(row, x, threshold);
+}
+
+TARGET_AVX2 uint32_t column_mask_avx2(const uint8_t *column, uint8_t threshold) {
+    return above_threshold_mask_avx2(column, _mm256_set1_epi8(static_cast<char>(threshold)));
+}
+#endif
+
+const ScanKernelVariant SCALAR_KERNELS = {"scalar", find_first_scalar, find_last_scalar, column_mask_scalar};
+#ifdef SCAN_KERNELS_X86
+const ScanKernelVariant SSE2_KERNELS = {"sse2", find_first_sse2, find_last_sse2, column_mask_sse2};
+const ScanKernelVariant AVX2_KERNELS = {"avx2", find_first_avx2, find_last_avx2, column_mask_avx2};
+#endif
+
+// The kernels are chosen once, the fastest one that the CPU supports.
+const ScanKernelVariant &scan_kernels() {
+    static const ScanKernelVariant kernels = get_scan_kernel_variants().back();
+    return kernels;
+}
+
+} // namespace
+
+std::vector<ScanKernelVariant> get_scan_kernel_variants() {
+    std::vector<ScanKernelVariant> variants = {SCALAR_KERNELS};
+#ifdef SCAN_KERNELS_X86
+    // The AVX2 kernels use the SSE2 kernels for the remaining pixels.
+    if (cv::checkHardwareSupport(CV_CPU_SSE2)) {
+        variants.push_back(SSE2_KERNELS);
+        if (cv::checkHardwareSupport(CV_CPU_AVX2)) {
+            variants.push_back(AVX2_KERNELS);
+        }
+    }
+#endif
+    return variants;
+}
+
+int find_first_above_threshold(const uint8_t *row, int length, uint8_t threshold) {
+    return scan_kernels().findFirst(row, length, threshold);
+}
+
+int find_last_above_threshold(const uint8_t *row, int length, uint8_t threshold) { return scan_kernels().findLast(row, length, threshold); }
+
+int find_first_luma_above_threshold(const uint8_t *bgr, int length, uint8_t threshold) {
+    for (int x = 0; x < length; ++x) {
+        if (bgr_to_luma(bgr + 3 * x) > threshold) {
+            return x;
+        }
+    }
+    return -1;
+}
+
+int find_last_luma_above_threshold(const uint8_t *bgr, int length, uint8_t threshold) {
+    for (int x = length - 1; x >= 0; --x) {
+        if (bgr_to_luma(bgr + 3 * x) > threshold) {
+            return x;
+        }
+    }
+    return -1;
+}
+
+void find_first_above_threshold_transposed(const uint8_t *tile, int columns, int rows, uint8_t threshold, int *first) {
+    assert(rows >= 1 && rows <= TRANSPOSED_TILE_ROWS);
+    static_assert(TRANSPOSED_TILE_ROWS == 32, "the column masks have one bit per row");
+
+    const auto column_mask = scan_kernels().columnMask;
+    uint32_t unresolved = rows == 32 ? 0xFFFFFFFFu : (1u << rows) - 1;
+    for (int r = 0; r < rows; ++r) {
+        first[r] = -1;
+    }
+
+    for (int c = 0; c < columns && unresolved != 0; ++c) {
+        uint32_t found = column_mask(tile + c * TRANSPOSED_TILE_ROWS, threshold) & unresolved;
+        unresolved &= ~found;
+        while (found != 0) {
+            first[lowest_bit(found)] = c;
+            found &= found - 1;
+        }
+    }
+}
+
+const char *scan_kernel_name() { return scan_kernels().name; }
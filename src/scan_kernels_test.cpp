@@ -0,0 +1,161 @@
+/**
+ * Tests every scan kernel variant that this CPU supports (see get_scan_kernel_variants) against a plain scalar loop
+ * (scan_kernels_test, run by ctest).
+ */
+#include "scan_kernels.h"
+#include <algorithm>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+using std::vector;
+
+namespace {
+
+// The longest row that is tested. The rows are longer than an AVX2 register, so that the vector loops, the SSE2 tail
+// and the scalar tail are all reached.
+const int MAX_LENGTH = 80;
+
+// The rows start at every offset within this many bytes, so that the unaligned loads are tested.
+const int MAX_OFFSET = 32;
+
+int failures = 0;
+
+int find_first_reference(const uint8_t *row, int length, uint8_t threshold) {
+    for (int x = 0; x < length; ++x) {
+        if (row[x] > threshold) {
+            return x;
+        }
+    }
+    return -1;
+}
+
+int find_last_reference(const uint8_t *row, int length, uint8_t threshold) {
+    for (int x = length - 1; x >= 0; --x) {
+        if (row[x] > threshold) {
+            return x;
+        }
+    }
+    return -1;
+}
+
+void check(bool ok, const ScanKernelVariant &variant, const std::string &what, int length, int offset, int threshold, int expected,
+           int actual) {
+    if (!ok) {
+        std::cerr << "FAILED: " << variant.name << " " << what << " (length " << length << ", offset " << offset << ", threshold "
+                  << threshold << "): expected " << expected << ", got " << actual << std::endl;
+        ++failures;
+    }
+}
+
+/**
+ * Fills row[0..length) with pixels that are not above threshold (including pixels equal to threshold) and sets the
+ * given number of random pixels above threshold.
+ */
+void fill_row(uint8_t *row, int length, uint8_t threshold, int bright_pixels, std::mt19937 &rng) {
+    std::uniform_int_distribution<int> dark(0, threshold);
+    for (int x = 0; x < length; ++x) {
+        row[x] = static_cast<uint8_t>(x % 3 == 0 ? threshold : dark(rng));
+    }
+    if (length == 0 || threshold == 255) {
+        return;
+    }
+    std::uniform_int_distribution<int> bright(threshold + 1, 255);
+    std::uniform_int_distribution<int> position(0, length - 1);
+    for (int i = 0; i < bright_pixels; ++i) {
+        row[position(rng)] = static_cast<uint8_t>(bright(rng));
+    }
+}
+
+void test_row_scans(const ScanKernelVariant &variant, std::mt19937 &rng) {
+    // 1 and 254 are the edges of the useful thresholds, the others are thresholds that also occur as pixel values.
+    const uint8_t thresholds[] = {1, 254, 0, 20, 128};
+    vector<uint8_t> buffer(MAX_OFFSET + MAX_LENGTH);
+
+    for (uint8_t threshold : thresholds) {
+        for (int length = 0; length <= MAX_LENGTH; ++length) {
+            for (int offset = 0; offset < MAX_OFFSET; ++offset) {
+                for (int bright_pixels = 0; bright_pixels <= 2; ++bright_pixels) {
+                    uint8_t *row = buffer.data() + offset;
+                    fill_row(row, length, threshold, bright_pixels, rng);
+
+                    int expected = find_first_reference(row, length, threshold);
+                    int actual = variant.findFirst(row, length, threshold);
+                    check(actual == expected, variant, "findFirst", length, offset, threshold, expected, actual);
+
+                    expected = find_last_reference(row, length, threshold);
+                    actual = variant.findLast(row, length, threshold);
+                    check(actual == expected, variant, "findLast", length, offset, threshold, expected, actual);
+                }
+            }
+        }
+    }
+}
+
+void test_column_masks(const ScanKernelVariant &variant, std::mt19937 &rng) {
+    const uint8_t thresholds[] = {1, 254, 0, 20, 128};
+    vector<uint8_t> buffer(MAX_OFFSET + TRANSPOSED_TILE_ROWS);
+
+    for (uint8_t threshold : thresholds) {
+        for (int offset = 0; offset < MAX_OFFSET; ++offset) {
+            for (int bright_pixels = 0; bright_pixels <= 8; ++bright_pixels) {
+                uint8_t *column = buffer.data() + offset;
+                fill_row(column, TRANSPOSED_TILE_ROWS, threshold, bright_pixels, rng);
+
+                uint32_t expected = 0;
+                for (int r = 0; r < TRANSPOSED_TILE_ROWS; ++r) {
+                    expected |= column[r] > threshold ? 1u << r : 0;
+                }
+                const uint32_t actual = variant.columnMask(column, threshold);
+                check(actual == expected, variant, "columnMask", TRANSPOSED_TILE_ROWS, offset, threshold, static_cast<int>(expected),
+                      static_cast<int>(actual));
+            }
+        }
+    }
+}
+
+// The transposed scan uses the chosen variant. It must find the same columns as the row-wise scan.
+void test_transposed_scan(std::mt19937 &rng) {
+    const ScanKernelVariant chosen = get_scan_kernel_variants().back();
+    const int columns = MAX_LENGTH;
+    vector<uint8_t> rows(TRANSPOSED_TILE_ROWS * columns);
+    vector<uint8_t> tile(TRANSPOSED_TILE_ROWS * columns);
+    int first[TRANSPOSED_TILE_ROWS];
+
+    for (uint8_t threshold : {1, 20, 254}) {
+        for (int tile_rows = 1; tile_rows <= TRANSPOSED_TILE_ROWS; ++tile_rows) {
+            for (int r = 0; r < TRANSPOSED_TILE_ROWS; ++r) {
+                fill_row(&rows[r * columns], columns, threshold, r % 3, rng);
+                for (int c = 0; c < columns; ++c) {
+                    tile[c * TRANSPOSED_TILE_ROWS + r] = rows[r * columns + c];
+                }
+            }
+
+            find_first_above_threshold_transposed(tile.data(), columns, tile_rows, threshold, first);
+            for (int r = 0; r < tile_rows; ++r) {
+                const int expected = find_first_reference(&rows[r * columns], columns, threshold);
+                check(first[r] == expected, chosen, "transposed row " + std::to_string(r), columns, 0, threshold, expected, first[r]);
+            }
+        }
+    }
+}
+
+} // namespace
+
+int main() {
+    std::mt19937 rng(0x5eed);
+    for (const ScanKernelVariant &variant : get_scan_kernel_variants()) {
+        std::cout << "Testing the " << variant.name << " kernels" << std::endl;
+        test_row_scans(variant, rng);
+        test_column_masks(variant, rng);
+    }
+    test_transposed_scan(rng);
+
+    if (failures > 0) {
+        std::cerr << failures << " checks failed" << std::endl;
+        return 1;
+    }
+    std::cout << "All checks passed (chosen kernel: " << scan_kernel_name() << ")" << std::endl;
+    return 0;
+}
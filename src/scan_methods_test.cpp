@@ -0,0 +1,138 @@
+/**
+ * Tests that SCAN_METHOD_FUSED detects the same line starts as SCAN_METHOD_GRAY, i.e. that computing the grayscale
+ * values on the fly (bgr_to_luma) gives the same result as cv::cvtColor with COLOR_BGR2GRAY in the OpenCV build that is
+ * linked (scan-methods-test, run by ctest). cv::cvtColor may use IPP or other SIMD code depending on the build.
+ */
+#include "DeshakeContext.h"
+#include "correct_frame.h"
+#include "scan_kernels.h"
+#include <algorithm>
+#include <iostream>
+#include <opencv2/imgproc.hpp>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+int failures = 0;
+
+/**
+ * Compares bgr_to_luma with cv::cvtColor for all 2^24 BGR values (one 4096x4096 image).
+ */
+void test_all_bgr_values() {
+    cv::Mat bgr(4096, 4096, CV_8UC3);
+    for (int y = 0; y < bgr.rows; ++y) {
+        uint8_t *row = bgr.ptr<uint8_t>(y);
+        for (int x = 0; x < bgr.cols; ++x) {
+            const int value = y * bgr.cols + x;
+            row[3 * x] = static_cast<uint8_t>(value & 0xff);
+            row[3 * x + 1] = static_cast<uint8_t>((value >> 8) & 0xff);
+            row[3 * x + 2] = static_cast<uint8_t>(value >> 16);
+        }
+    }
+    cv::Mat gray;
+    cv::cvtColor(bgr, gray, cv::COLOR_BGR2GRAY);
+
+    long mismatches = 0;
+    for (int y = 0; y < bgr.rows; ++y) {
+        const uint8_t *bgr_row = bgr.ptr<uint8_t>(y);
+        const uint8_t *gray_row = gray.ptr<uint8_t>(y);
+        for (int x = 0; x < bgr.cols; ++x) {
+            if (bgr_to_luma(bgr_row + 3 * x) != gray_row[x]) {
+                if (mismatches == 0) {
+                    std::cerr << "FAILED: BGR " << (y * bgr.cols + x) << ": bgr_to_luma " << static_cast<int>(bgr_to_luma(bgr_row + 3 * x))
+                              << ", cv::cvtColor " << static_cast<int>(gray_row[x]) << std::endl;
+                }
+                ++mismatches;
+            }
+        }
+    }
+    if (mismatches > 0) {
+        std::cerr << "FAILED: bgr_to_luma differs from cv::cvtColor for " << mismatches << " BGR values" << std::endl;
+        ++failures;
+    } else {
+        std::cout << "bgr_to_luma matches cv::cvtColor for all BGR values" << std::endl;
+    }
+}
+
+/**
+ * Creates a BGR frame whose borders are random pixels with a luma around threshold, so that the rounding of the
+ * grayscale conversion decides where the line starts are found.
+ */
+cv::Mat create_frame(const cv::Size &frameSize, int threshold, std::mt19937 &rng) {
+    std::uniform_int_distribution<int> border(0, std::min(255, 2 * threshold + 8));
+    std::uniform_int_distribution<int> content(0, 255);
+    std::uniform_int_distribution<int> border_width(0, frameSize.width / 4);
+
+    cv::Mat frame(frameSize, CV_8UC3);
+    for (int y = 0; y < frameSize.height; ++y) {
+        const int left = border_width(rng);
+        const int right = frameSize.width - border_width(rng);
+        uint8_t *row = frame.ptr<uint8_t>(y);
+        for (int x = 0; x < frameSize.width; ++x) {
+            for (int c = 0; c < 3; ++c) {
+                row[3 * x + c] = static_cast<uint8_t>(x < left || x >= right ? border(rng) : content(rng));
+            }
+        }
+    }
+    return frame;
+}
+
+bool same_line_starts(const std::vector<int> &fused, const std::vector<int> &gray, const std::string &what, const std::string &name) {
+    const auto mismatch = std::mismatch(fused.begin(), fused.end(), gray.begin());
+    if (mismatch.first == fused.end()) {
+        return true;
+    }
+    std::cerr << "FAILED: " << name << ": " << what << " of row " << (mismatch.first - fused.begin()) << " differ (fused "
+              << *mismatch.first << ", gray " << *mismatch.second << ")" << std::endl;
+    return false;
+}
+
+void test_scan_methods(std::mt19937 &rng) {
+    const cv::Size frameSize(720, 576);
+    for (int threshold : {1, 20, 128, 254}) {
+        for (int col_range : {16, 64, 200}) {
+            ProcessingParameters fused;
+            fused.pureBlackThreshold = threshold;
+            fused.colRange = col_range;
+            fused.pureBlackWidth = std::min(8, col_range / 2);
+            fused.targetLineStart = fused.pureBlackWidth;
+            fused.scanMethod = ProcessingParameters::SCAN_METHOD_FUSED;
+            ProcessingParameters gray = fused;
+            gray.scanMethod = ProcessingParameters::SCAN_METHOD_GRAY;
+
+            const cv::Mat frame = create_frame(frameSize, threshold, rng);
+            DeshakeContext fused_context;
+            DeshakeContext gray_context;
+            fused_context.keepRawLineStarts = true;
+            gray_context.keepRawLineStarts = true;
+            analyze_frame(frame, fused, fused_context);
+            analyze_frame(frame, gray, gray_context);
+
+            const std::string name = "threshold " + std::to_string(threshold) + ", colrange " + std::to_string(col_range);
+            const bool same = same_line_starts(fused_context.rawLineStarts, gray_context.rawLineStarts, "raw line starts", name) &&
+                              same_line_starts(fused_context.rawLineEnds, gray_context.rawLineEnds, "raw line ends", name) &&
+                              same_line_starts(fused_context.lineStarts, gray_context.lineStarts, "line starts", name);
+            if (!same) {
+                ++failures;
+            }
+        }
+    }
+}
+
+} // namespace
+
+int main() {
+    test_all_bgr_values();
+
+    std::mt19937 rng(0x5eed);
+    test_scan_methods(rng);
+
+    if (failures > 0) {
+        std::cerr << failures << " checks failed" << std::endl;
+        return 1;
+    }
+    std::cout << "All checks passed" << std::endl;
+    return 0;
+}